@@ -0,0 +1,106 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "Atlas/AtlasPacker.h"
+#include "Config.h"
+#include "Image.h"
+#include "Utils.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+    const uint32_t Rounds = 5u;
+    const uint32_t MaxTextureSize = 8192u;
+
+    bool Measure(AtlasPacker& packer, const sSize& size, const cWorkerPool& workers, uint64_t& best)
+    {
+        best = UINT64_MAX;
+        for (uint32_t round = 0; round < Rounds; round++)
+        {
+            const auto start = getCurrentTime();
+            if (packer.buildAtlas(size, workers) == false)
+            {
+                return false;
+            }
+            best = std::min(best, getCurrentTime() - start);
+        }
+
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        ::printf("Usage:\n");
+        ::printf("  %s INPUT_IMAGE [INPUT_IMAGE]\n", argv[0]);
+        return -1;
+    }
+
+    sConfig config;
+    config.maxTextureSize = MaxTextureSize;
+
+    std::vector<std::unique_ptr<cImage>> images;
+    for (int i = 1; i < argc; i++)
+    {
+        std::unique_ptr<cImage> image(new cImage());
+        if (image->load(argv[i], 0u, nullptr, nullptr) == false)
+        {
+            ::printf("(EE) Error loading '%s'.\n", argv[i]);
+            return -1;
+        }
+        images.push_back(std::move(image));
+    }
+
+    const sSize maxSize{ config.maxTextureSize, config.maxTextureSize };
+    auto packer = AtlasPacker::create(static_cast<uint32_t>(images.size()), config);
+    packer->setSize(maxSize);
+    for (auto& image : images)
+    {
+        if (packer->add(image.get(), AtlasPacker::Turn::None) == false)
+        {
+            ::printf("(EE) Sprites don't fit %u x %u atlas.\n", maxSize.width, maxSize.height);
+            return -1;
+        }
+    }
+
+    const auto size = packer->getUsedSize(maxSize);
+    const cWorkerPool workers(config.threads);
+    ::printf("Compose %u sprites to %u x %u atlas, %u threads, best of %u rounds.\n",
+             static_cast<uint32_t>(images.size()),
+             size.width,
+             size.height,
+             workers.getThreadsCount(),
+             Rounds);
+
+    // packer keeps reference to config, so overlay is switched between runs
+    uint64_t plainTime;
+    uint64_t overlayTime;
+    config.overlay = false;
+    const bool isPlainBuilt = Measure(*packer, size, workers, plainTime);
+    config.overlay = true;
+    if (isPlainBuilt == false || Measure(*packer, size, workers, overlayTime) == false)
+    {
+        return -1;
+    }
+
+    const double pixels = double(size.width) * size.height;
+    ::printf(" - plain:   %.3f ms (%.1f Mpx/s)\n", plainTime * 0.001, pixels / double(std::max<uint64_t>(plainTime, 1u)));
+    ::printf(" - overlay: %.3f ms (%.1f Mpx/s)\n", overlayTime * 0.001, pixels / double(std::max<uint64_t>(overlayTime, 1u)));
+    ::printf(" - overlay cost: %.3f ms\n", (double(overlayTime) - double(plainTime)) * 0.001);
+
+    return 0;
+}
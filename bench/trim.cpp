@@ -0,0 +1,245 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "Trim.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+    const uint32_t AlphaThreshold = 0u;
+    const uint32_t Rounds = 5u;
+
+    class cBenchTrim final : public cTrim
+    {
+    public:
+        using cTrim::cTrim;
+        using cTrim::findBounds;
+    };
+
+    struct sBounds
+    {
+        uint32_t left;
+        uint32_t top;
+        uint32_t right;
+        uint32_t bottom;
+        bool isFound;
+
+        bool operator==(const sBounds& other) const
+        {
+            return isFound == other.isFound
+                && (isFound == false
+                    || (left == other.left && top == other.top && right == other.right && bottom == other.bottom));
+        }
+    };
+
+    // Four column and row scans findBounds() has replaced, the reference
+    // for both bounds and time. Left and right ones walk down the columns.
+    uint32_t FindLeft(const cBitmap& input, uint32_t threshold)
+    {
+        auto& size = input.getSize();
+        for (uint32_t x = 0u; x < size.width; x++)
+        {
+            auto src = input.getData() + x;
+            for (uint32_t y = 0u; y < size.height; y++)
+            {
+                if (src->a > threshold)
+                {
+                    return x;
+                }
+                src += input.getPitch();
+            }
+        }
+
+        return size.width;
+    }
+
+    uint32_t FindRigth(const cBitmap& input, uint32_t threshold)
+    {
+        auto& size = input.getSize();
+        for (uint32_t x = 0; x < size.width; x++)
+        {
+            uint32_t offset = size.width - x - 1;
+            auto src = input.getData() + offset;
+            for (uint32_t y = 0; y < size.height; y++)
+            {
+                if (src->a > threshold)
+                {
+                    return offset;
+                }
+                src += input.getPitch();
+            }
+        }
+
+        return 0;
+    }
+
+    uint32_t FindTop(const cBitmap& input, uint32_t threshold)
+    {
+        auto& size = input.getSize();
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            auto src = input.getData() + y * input.getPitch();
+            for (uint32_t x = 0; x < size.width; x++)
+            {
+                if (src->a > threshold)
+                {
+                    return y;
+                }
+                src++;
+            }
+        }
+
+        return size.height;
+    }
+
+    uint32_t FindBottom(const cBitmap& input, uint32_t threshold)
+    {
+        auto& size = input.getSize();
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            uint32_t offset = size.height - y - 1;
+            auto src = input.getData() + offset * input.getPitch();
+            for (uint32_t x = 0; x < size.width; x++)
+            {
+                if (src->a > threshold)
+                {
+                    return offset;
+                }
+                src++;
+            }
+        }
+
+        return 0;
+    }
+
+    sBounds BaselineBounds(const cBitmap& bitmap, uint32_t threshold)
+    {
+        sBounds bounds;
+        bounds.left = FindLeft(bitmap, threshold);
+        bounds.right = FindRigth(bitmap, threshold);
+        bounds.top = FindTop(bitmap, threshold);
+        bounds.bottom = FindBottom(bitmap, threshold);
+        bounds.isFound = bounds.left <= bounds.right && bounds.top <= bounds.bottom;
+
+        return bounds;
+    }
+
+    uint32_t Random(uint32_t& seed)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    }
+
+    // Sprites with transparent margins of random width, a few of them are
+    // fully opaque or fully transparent.
+    void GenerateSprites(uint32_t count, std::vector<std::unique_ptr<cBitmap>>& sprites)
+    {
+        uint32_t seed = 1u;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const sSize size{ 32u + Random(seed) % 480u, 32u + Random(seed) % 480u };
+            std::unique_ptr<cBitmap> bitmap(new cBitmap());
+            bitmap->createBitmap(size);
+
+            sRect rc{ 0u, 0u, 0u, 0u };
+            const auto kind = i % 16u;
+            if (kind == 0u)
+            {
+                rc = { 0u, 0u, size.width, size.height };
+            }
+            else if (kind != 1u)
+            {
+                rc.left = Random(seed) % (size.width / 2u);
+                rc.top = Random(seed) % (size.height / 2u);
+                rc.right = rc.left + 1u + Random(seed) % (size.width - rc.left);
+                rc.bottom = rc.top + 1u + Random(seed) % (size.height - rc.top);
+            }
+
+            for (uint32_t y = 0; y < size.height; y++)
+            {
+                auto row = bitmap->getData() + y * bitmap->getPitch();
+                for (uint32_t x = 0; x < size.width; x++)
+                {
+                    const bool isInside = x >= rc.left && x < rc.right && y >= rc.top && y < rc.bottom;
+                    const auto v = static_cast<uint8_t>(Random(seed));
+                    row[x] = { v, v, v, static_cast<uint8_t>(isInside ? 255u : 0u) };
+                }
+            }
+
+            sprites.push_back(std::move(bitmap));
+        }
+    }
+
+    template <typename Scan>
+    uint64_t Measure(const std::vector<std::unique_ptr<cBitmap>>& sprites, std::vector<sBounds>& results, const Scan& scan)
+    {
+        uint64_t best = UINT64_MAX;
+        for (uint32_t round = 0; round < Rounds; round++)
+        {
+            const auto start = getCurrentTime();
+            for (size_t i = 0; i < sprites.size(); i++)
+            {
+                results[i] = scan(*sprites[i]);
+            }
+            best = std::min(best, getCurrentTime() - start);
+        }
+
+        return best;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const uint32_t count = argc > 1 ? static_cast<uint32_t>(::atoi(argv[1])) : 500u;
+
+    std::vector<std::unique_ptr<cBitmap>> sprites;
+    GenerateSprites(count, sprites);
+
+    uint64_t pixels = 0u;
+    for (auto& sprite : sprites)
+    {
+        pixels += uint64_t(sprite->getSize().width) * sprite->getSize().height;
+    }
+    ::printf("Trim bounds of %u sprites, %llu pixels, best of %u rounds.\n", count, static_cast<unsigned long long>(pixels), Rounds);
+
+    cBenchTrim trim(AlphaThreshold);
+    std::vector<sBounds> fast(sprites.size());
+    const auto fastTime = Measure(sprites, fast, [&trim](const cBitmap& bitmap) {
+        sBounds b;
+        b.isFound = trim.findBounds(bitmap, b.left, b.top, b.right, b.bottom);
+        return b;
+    });
+
+    std::vector<sBounds> baseline(sprites.size());
+    const auto baselineTime = Measure(sprites, baseline, [](const cBitmap& bitmap) {
+        return BaselineBounds(bitmap, AlphaThreshold);
+    });
+
+    for (size_t i = 0; i < sprites.size(); i++)
+    {
+        if ((fast[i] == baseline[i]) == false)
+        {
+            ::printf("(EE) Bounds of sprite %u differ from baseline scans.\n", static_cast<uint32_t>(i));
+            return -1;
+        }
+    }
+
+    ::printf(" - findBounds: %.3f ms (%.1f Mpx/s)\n", fastTime * 0.001, pixels / double(std::max<uint64_t>(fastTime, 1u)));
+    ::printf(" - baseline:   %.3f ms (%.1f Mpx/s)\n", baselineTime * 0.001, pixels / double(std::max<uint64_t>(baselineTime, 1u)));
+    ::printf(" - speedup: %.2fx\n", baselineTime / double(std::max<uint64_t>(fastTime, 1u)));
+
+    return 0;
+}
@@ -7,222 +7,659 @@
 \**********************************************/
 
 #include "AtlasPacker.h"
+#include "AtlasSize.h"
 #include "Config.h"
 #include "File.h"
 #include "Image.h"
 #include "KDTreePacker.h"
+#include "MaxRectsPacker.h"
 #include "SimplePacker.h"
-#include "Trim.h"
+#include "SkylinePacker.h"
 #include "Types/Types.h"
+#include "WorkerPool.h"
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <sstream>
 
-std::unique_ptr<AtlasPacker> AtlasPacker::create(uint32_t count, const sConfig& config)
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
 {
-    if (config.slowMethod)
+
+    struct sMethodName
     {
-        return std::make_unique<SimplePacker>(count, config);
+        Method method;
+        const char* name;
+    };
+
+    const sMethodName MethodNames[] = {
+        { Method::KDTree, "kdtree" },
+        { Method::Simple, "slow" },
+        { Method::MaxRects, "maxrects" },
+        { Method::Skyline, "skyline" },
+        { Method::Best, "best" },
+    };
+
+    struct sHeuristicName
+    {
+        Heuristic heuristic;
+        const char* name;
+    };
+
+    const sHeuristicName HeuristicNames[] = {
+        { Heuristic::BestShortSideFit, "bssf" },
+        { Heuristic::BestLongSideFit, "blsf" },
+        { Heuristic::BestAreaFit, "baf" },
+        { Heuristic::ContactPoint, "cp" },
+    };
+
+    // JSON string contents, quotes aren't added.
+    std::string EscapeJson(const std::string& text)
+    {
+        std::string result;
+        result.reserve(text.length());
+        for (auto c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20u)
+            {
+                char code[8];
+                ::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+                result += code;
+            }
+            else
+            {
+                result += c;
+            }
+        }
+        return result;
     }
 
-    return std::make_unique<KDTreePacker>(config);
-}
+    // Turns by 90 degrees clockwise: source row y becomes destination column (height - 1 - y).
+    // Goes by square blocks, so both source rows and destination columns stay in cache.
+    void CopyRotated(const cBitmap::Pixel* src, uint32_t srcPitch, const sSize& size, cBitmap::Pixel* dst, uint32_t dstPitch)
+    {
+        const uint32_t Block = 16u;
 
-AtlasPacker::AtlasPacker(const sConfig& config)
-    : m_config(config)
-{
-}
+        for (uint32_t by = 0; by < size.height; by += Block)
+        {
+            const auto ey = std::min(by + Block, size.height);
+            for (uint32_t bx = 0; bx < size.width; bx += Block)
+            {
+                const auto ex = std::min(bx + Block, size.width);
+                for (uint32_t y = by; y < ey; y++)
+                {
+                    auto s = src + y * srcPitch;
+                    auto d = dst + (size.height - 1 - y);
+                    for (uint32_t x = bx; x < ex; x++)
+                    {
+                        d[x * dstPitch] = s[x];
+                    }
+                }
+            }
+        }
+    }
 
-AtlasPacker::~AtlasPacker()
-{
-}
+    // Straight copy of sprite rows, left and right padding are filled
+    // from the edge pixels of each row on the way.
+    template <bool HasPadding>
+    void CopyRows(const cBitmap::Pixel* src, uint32_t srcPitch, const sSize& size, cBitmap::Pixel* dst, uint32_t dstPitch, uint32_t padding)
+    {
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            if constexpr (HasPadding)
+            {
+                std::fill_n(dst - padding, padding, src[0]);
+                std::fill_n(dst + size.width, padding, src[size.width - 1]);
+            }
+            std::copy_n(src, size.width, dst);
 
-void AtlasPacker::copyBitmap(const sRect& rc, const cImage* image, bool overlay)
-{
-    auto& bmp = image->getBitmap();
+            src += srcPitch;
+            dst += dstPitch;
+        }
+    }
 
-    const auto& size = bmp.getSize();
+    void ExtrudeSides(cBitmap::Pixel* placed, uint32_t pitch, const sSize& size, uint32_t padding)
+    {
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            auto row = placed + y * pitch;
+            std::fill_n(row - padding, padding, row[0]);
+            std::fill_n(row + size.width, padding, row[size.width - 1]);
+        }
+    }
 
-    const auto padding = m_config.padding;
+    // Padded row of sprite row y, written from the box left edge. Rows of
+    // turned sprite are source columns read bottom up.
+    void PadRow(const cBitmap& bmp, bool rotated, uint32_t y, cBitmap::Pixel* dst, uint32_t padding)
+    {
+        const auto& srcSize = bmp.getSize();
+        const auto src = bmp.getData();
+        auto placed = dst + padding;
 
-    const auto offx = rc.left;
-    const auto offy = rc.top;
-    const auto offxPadded = offx + padding;
-    const auto offyPadded = offy + padding;
-    const auto pitch = m_atlas.getPitch();
+        uint32_t width = srcSize.width;
+        if (rotated)
+        {
+            width = srcSize.height;
+            const auto pitch = bmp.getPitch();
+            for (uint32_t x = 0; x < width; x++)
+            {
+                placed[x] = src[(width - 1 - x) * pitch + y];
+            }
+        }
+        else
+        {
+            std::copy_n(src + y * bmp.getPitch(), width, placed);
+        }
 
-    auto srcData = bmp.getData();
-    auto dstData = m_atlas.getData();
+        std::fill_n(dst, padding, placed[0]);
+        std::fill_n(placed + width, padding, placed[width - 1]);
+    }
 
-    for (uint32_t y = 0; y < size.height; y++)
+    // Overlay in 8 bit fixed point, per channel c = (d * (255 - a) + s * a) / 255
+    // rounded, source alpha is 255. Every instruction set does the same integer
+    // math, so results are bit-exact on all of them.
+    struct sOverlay
     {
-        auto dst = dstData + (y + offyPadded) * pitch + offxPadded;
-        for (uint32_t x = 0; x < size.width; x++)
-        {
-            *dst++ = *srcData++;
-        }
+        uint16_t inv; // 255 - alpha
+        uint16_t add[4]; // source channel * alpha
+    };
+
+    sOverlay GetOverlay(const sConfig& config)
+    {
+        const uint32_t alpha = std::min(config.overlayAlpha, 255u);
+        const uint32_t color = config.overlayColor;
+
+        sOverlay overlay;
+        overlay.inv = static_cast<uint16_t>(255u - alpha);
+        overlay.add[0] = static_cast<uint16_t>(((color >> 16) & 0xffu) * alpha);
+        overlay.add[1] = static_cast<uint16_t>(((color >> 8) & 0xffu) * alpha);
+        overlay.add[2] = static_cast<uint16_t>((color & 0xffu) * alpha);
+        overlay.add[3] = static_cast<uint16_t>(255u * alpha);
+
+        return overlay;
+    }
+
+    // x / 255 rounded, exact for any x up to 255 * 255
+    uint32_t Div255(uint32_t x)
+    {
+        x += 128u;
+        return (x + (x >> 8)) >> 8;
+    }
+
+#if defined(__AVX2__)
+
+    const uint32_t BlendLanes = 8u;
+
+    __m256i Blend16(__m256i px, __m256i inv, __m256i add)
+    {
+        auto x = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(px, inv), add), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+
+    // unpack and pack work inside 128 bit halves, so pixels keep their places
+    void BlendLanesRow(cBitmap::Pixel* dst, const sOverlay& overlay)
+    {
+        const auto inv = _mm256_set1_epi16(static_cast<short>(overlay.inv));
+        const auto add = _mm256_setr_epi16(overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3],
+                                           overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3],
+                                           overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3],
+                                           overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3]);
+        const auto zero = _mm256_setzero_si256();
+
+        auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+        auto lo = Blend16(_mm256_unpacklo_epi8(px, zero), inv, add);
+        auto hi = Blend16(_mm256_unpackhi_epi8(px, zero), inv, add);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_packus_epi16(lo, hi));
+    }
+
+#elif defined(__SSE2__)
+
+    const uint32_t BlendLanes = 4u;
+
+    __m128i Blend16(__m128i px, __m128i inv, __m128i add)
+    {
+        auto x = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(px, inv), add), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+
+    void BlendLanesRow(cBitmap::Pixel* dst, const sOverlay& overlay)
+    {
+        const auto inv = _mm_set1_epi16(static_cast<short>(overlay.inv));
+        const auto add = _mm_setr_epi16(overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3],
+                                        overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3]);
+        const auto zero = _mm_setzero_si128();
+
+        auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+        auto lo = Blend16(_mm_unpacklo_epi8(px, zero), inv, add);
+        auto hi = Blend16(_mm_unpackhi_epi8(px, zero), inv, add);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(lo, hi));
+    }
+
+#elif defined(__ARM_NEON)
+
+    const uint32_t BlendLanes = 4u;
+
+    uint16x8_t Blend16(uint16x8_t px, uint16x8_t inv, uint16x8_t add)
+    {
+        auto x = vaddq_u16(vmlaq_u16(add, px, inv), vdupq_n_u16(128));
+        return vshrq_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
     }
 
-    if (padding > 0)
+    void BlendLanesRow(cBitmap::Pixel* dst, const sOverlay& overlay)
+    {
+        const auto inv = vdupq_n_u16(overlay.inv);
+        const uint16x8_t add = { overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3],
+                                 overlay.add[0], overlay.add[1], overlay.add[2], overlay.add[3] };
+
+        auto px = vld1q_u8(reinterpret_cast<const uint8_t*>(dst));
+        auto lo = Blend16(vmovl_u8(vget_low_u8(px)), inv, add);
+        auto hi = Blend16(vmovl_u8(vget_high_u8(px)), inv, add);
+        vst1q_u8(reinterpret_cast<uint8_t*>(dst), vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    }
+
+#else
+
+    const uint32_t BlendLanes = 0u;
+
+    void BlendLanesRow(cBitmap::Pixel* /*dst*/, const sOverlay& /*overlay*/)
     {
-        // adding the border
-        /*
-          Consider the following picture:
-          ++======++
-          ++======++
-          ||oooooo||
-          ||oooooo||
-          ||oooooo||
-          ||oooooo||
-          ++======++
-          ++======++
+    }
 
-          o - image pixels, copied in the previous loop
-          | - left and right border
-          = - top and bottom border
-          + - corner pixels
-        */
+#endif
 
-        auto srcLeft = bmp.getData();
-        for (uint32_t y = 0; y < size.height; ++y)
+    void Overlay(cBitmap::Pixel* placed, uint32_t pitch, const sSize& size, const sOverlay& overlay)
+    {
+        for (uint32_t y = 0; y < size.height; y++)
         {
-            auto left = dstData + (y + offyPadded) * pitch + offx;
-            auto right = dstData + (y + offyPadded) * pitch + offxPadded + size.width;
-            for (uint32_t i = 0; i < padding; ++i)
+            auto dst = placed + y * pitch;
+
+            uint32_t x = 0;
+            if constexpr (BlendLanes != 0u)
             {
-                *(left + i) = *srcLeft;
-                *(right + i) = *(srcLeft + size.width - 1);
+                for (; x + BlendLanes <= size.width; x += BlendLanes)
+                {
+                    BlendLanesRow(dst + x, overlay);
+                }
+            }
+
+            for (; x < size.width; x++)
+            {
+                auto& p = dst[x];
+                p = {
+                    static_cast<uint8_t>(Div255(p.r * overlay.inv + overlay.add[0])),
+                    static_cast<uint8_t>(Div255(p.g * overlay.inv + overlay.add[1])),
+                    static_cast<uint8_t>(Div255(p.b * overlay.inv + overlay.add[2])),
+                    static_cast<uint8_t>(Div255(p.a * overlay.inv + overlay.add[3]))
+                };
             }
-            srcLeft += size.width;
         }
+    }
 
-        auto srcTop = bmp.getData();
-        for (uint32_t x = 0; x < size.width; ++x)
+    // Rows [begin, end) of padded box: padding rows above repeat the first
+    // sprite row, the ones below repeat the last. Padding is taken from
+    // sprite pixels before overlay is drawn over them.
+    template <bool HasPadding, bool HasOverlay>
+    void Compose(const cBitmap& bmp, bool rotated, cBitmap::Pixel* box, uint32_t pitch, uint32_t padding, uint32_t begin, uint32_t end,
+                 const sOverlay& overlay)
+    {
+        const auto& srcSize = bmp.getSize();
+        const auto size = rotated
+            ? sSize{ srcSize.height, srcSize.width }
+            : srcSize;
+
+        const auto first = std::min(std::max(begin, padding), padding + size.height) - padding;
+        const auto last = std::min(std::max(end, padding), padding + size.height) - padding;
+        if (first < last)
         {
-            auto top = dstData + offy * pitch + offxPadded + x;
-            auto bottom = dstData + (offyPadded + size.height) * pitch + offxPadded + x;
-            for (uint32_t i = 0; i < padding; ++i)
+            const sSize rows{ size.width, last - first };
+            auto placed = box + (padding + first) * pitch + padding;
+            if (rotated)
+            {
+                // turned rows [first, last) are source columns [first, last)
+                CopyRotated(bmp.getData() + first, bmp.getPitch(), { rows.height, srcSize.height }, placed, pitch);
+                if constexpr (HasPadding)
+                {
+                    ExtrudeSides(placed, pitch, rows, padding);
+                }
+            }
+            else
+            {
+                CopyRows<HasPadding>(bmp.getData() + first * bmp.getPitch(), bmp.getPitch(), rows, placed, pitch, padding);
+            }
+
+            if constexpr (HasOverlay)
             {
-                *(top + pitch * i) = *srcTop;
-                *(bottom + pitch * i) = *(srcTop + size.width * (size.height - 1));
+                Overlay(placed, pitch, rows, overlay);
             }
-            srcTop++;
         }
 
-        // border corner pixels
+        if constexpr (HasPadding)
         {
-            auto dst = dstData + offx + offy * pitch;
-            auto widthOffset = size.width + padding;
-            auto heightOffset = size.height + padding;
+            for (auto y = begin; y < std::min(end, padding); y++)
+            {
+                PadRow(bmp, rotated, 0u, box + y * pitch, padding);
+            }
+            for (auto y = std::max(begin, padding + size.height); y < end; y++)
+            {
+                PadRow(bmp, rotated, size.height - 1, box + y * pitch, padding);
+            }
+        }
+    }
 
-            auto topLeft = dst;
-            auto topRight = dst + widthOffset;
-            auto bottomLeft = dst + pitch * heightOffset;
-            auto bottomRight = dst + pitch * heightOffset + widthOffset;
+    const uint32_t BandsPerThread = 4u;
 
-            auto src = dstData + offyPadded * pitch + offxPadded;
+} // namespace
 
-            auto tlValue = *src;
-            auto trValue = *(src + size.width - 1);
-            auto blValue = *(src + pitch * (size.height - 1));
-            auto brValue = *(src + pitch * (size.height - 1) + size.width - 1);
-            for (uint32_t x = 0; x < padding; ++x)
-            {
-                for (uint32_t y = 0; y < padding; ++y)
-                {
-                    auto c = x * pitch + y;
+std::unique_ptr<AtlasPacker> AtlasPacker::create(uint32_t count, const sConfig& config)
+{
+    switch (config.method)
+    {
+    case Method::Simple:
+        return std::make_unique<SimplePacker>(count, config);
 
-                    *(topLeft + c) = tlValue;
-                    *(topRight + c) = trValue;
-                    *(bottomLeft + c) = blValue;
-                    *(bottomRight + c) = brValue;
-                }
-            }
+    case Method::MaxRects:
+        return std::make_unique<MaxRectsPacker>(count, config);
+
+    case Method::Skyline:
+        return std::make_unique<SkylinePacker>(count, config);
+
+    case Method::KDTree:
+    case Method::Best:
+        break;
+    }
+
+    return std::make_unique<KDTreePacker>(count, config);
+}
+
+const char* AtlasPacker::GetMethodName(Method method)
+{
+    for (auto& m : MethodNames)
+    {
+        if (m.method == method)
+        {
+            return m.name;
         }
     }
 
-    if (overlay)
+    return "unknown";
+}
+
+bool AtlasPacker::ParseMethod(const char* name, Method& method)
+{
+    for (auto& m : MethodNames)
     {
-        const float sR = 0.0f;
-        const float sG = 1.0f;
-        const float sB = 0.0f;
-        const float sA = 0.6f;
-        const float inv = 1.0f / 255.0f;
+        if (::strcmp(m.name, name) == 0)
+        {
+            method = m.method;
+            return true;
+        }
+    }
 
-        for (uint32_t y = 0; y < size.height; y++)
+    return false;
+}
+
+const char* AtlasPacker::GetHeuristicName(Heuristic heuristic)
+{
+    for (auto& h : HeuristicNames)
+    {
+        if (h.heuristic == heuristic)
         {
-            auto dst = dstData + (y + offyPadded) * pitch + offxPadded;
-            for (uint32_t x = 0; x < size.width; x++)
-            {
-                const float dR = dst->r * inv;
-                const float dG = dst->g * inv;
-                const float dB = dst->b * inv;
-                const float dA = dst->a * inv;
+            return h.name;
+        }
+    }
 
-                const float r = sA * (sR - dR) + dR;
-                const float g = sA * (sG - dG) + dG;
-                const float b = sA * (sB - dB) + dB;
-                const float a = dA * (1.0f - sA) + sA;
+    return "unknown";
+}
 
-                *dst++ = {
-                    static_cast<uint8_t>(r * 255.0f),
-                    static_cast<uint8_t>(g * 255.0f),
-                    static_cast<uint8_t>(b * 255.0f),
-                    static_cast<uint8_t>(a * 255.0f)
-                };
-            }
+bool AtlasPacker::ParseHeuristic(const char* name, Heuristic& heuristic)
+{
+    for (auto& h : HeuristicNames)
+    {
+        if (::strcmp(h.name, name) == 0)
+        {
+            heuristic = h.heuristic;
+            return true;
         }
     }
+
+    return false;
 }
 
-void AtlasPacker::buildAtlas()
+AtlasPacker::AtlasPacker(const sConfig& config)
+    : m_config(config)
 {
-    makeAtlas(m_config.overlay);
+}
 
-    cTrimRigthBottom trim(m_config);
-    if (trim.trim("atlas", m_atlas))
+AtlasPacker::~AtlasPacker()
+{
+}
+
+bool AtlasPacker::createAtlas(const sSize& size)
+{
+    // big atlases go to (huge) pages straight from the kernel
+    const size_t HugeAtlasSize = 2u * 1024u * 1024u;
+    const auto bytes = size_t(size.width) * size.height * sizeof(cBitmap::Pixel);
+    auto& allocator = bytes >= HugeAtlasSize
+        ? cAllocator::GetMmap()
+        : cAllocator::GetHeap();
+
+    if (m_atlas.createBitmap(size, allocator) == false)
+    {
+        ::printf("(EE) Can't allocate memory for %u x %u atlas.\n", size.width, size.height);
+        return false;
+    }
+
+    // mmap pages are already zeroed, gaps between sprites must not contain garbage
+    if (&allocator != &cAllocator::GetMmap())
     {
-        m_atlas = std::move(trim.getBitmap());
+        ::memset(m_atlas.getData(), 0, m_atlas.getDataSize());
     }
+
+    return true;
 }
 
-bool AtlasPacker::generateResFile(const char* name, const char* atlasName)
+void AtlasPacker::copyBitmap(const sRect& rc, const cImage* image, bool rotated, cArenaAllocator& arena, uint32_t begin, uint32_t end)
+{
+    if (m_config.lazyDecode == false)
+    {
+        copyBitmap(rc, image->getBitmap(), rotated, begin, end);
+        return;
+    }
+
+    // pixels live only while the sprite is being copied
+    cBitmap bmp;
+    if (image->decode(bmp, arena))
+    {
+        copyBitmap(rc, bmp, rotated, begin, end);
+    }
+    else
+    {
+        ::printf("(WW) Image '%s' not decoded.\n", image->getName().c_str());
+    }
+
+    bmp.clear();
+    arena.reset();
+}
+
+void AtlasPacker::copyBitmap(const sRect& rc, const cBitmap& bmp, bool rotated, uint32_t begin, uint32_t end)
+{
+    const auto padding = m_config.padding;
+    const auto pitch = m_atlas.getPitch();
+
+    // padded box in atlas, sprite pixels go at padding from its edges
+    auto box = m_atlas.getData() + rc.top * pitch + rc.left;
+
+    if (m_config.overlay == false)
+    {
+        const sOverlay none{};
+        padding == 0
+            ? Compose<false, false>(bmp, rotated, box, pitch, padding, begin, end, none)
+            : Compose<true, false>(bmp, rotated, box, pitch, padding, begin, end, none);
+    }
+    else
+    {
+        const auto overlay = GetOverlay(m_config);
+        padding == 0
+            ? Compose<false, true>(bmp, rotated, box, pitch, padding, begin, end, overlay)
+            : Compose<true, true>(bmp, rotated, box, pitch, padding, begin, end, overlay);
+    }
+}
+
+bool AtlasPacker::buildAtlas(const sSize& size, const cWorkerPool& workers)
+{
+    // exact size is known from rects, nothing is cropped afterwards
+    if (createAtlas(getUsedSize(size)) == false)
+    {
+        return false;
+    }
+
+    const auto threads = workers.getThreadsCount();
+    while (m_arenas.size() < threads)
+    {
+        m_arenas.push_back(std::make_unique<cArenaAllocator>(4u * 1024u * 1024u));
+    }
+
+    // Padded boxes never overlap, so bands are filled independently. Every band
+    // gets the rows of sprites crossing it, memory of a band is written (and first
+    // touched) by one thread. Sprites decoded on demand are composed whole by the
+    // band of their top row, to be decoded once.
+    const auto height = m_atlas.getSize().height;
+    const auto bandsCount = std::max(1u, std::min(height, threads > 1u ? threads * BandsPerThread : 1u));
+    const auto bandHeight = std::max(1u, (height + bandsCount - 1u) / bandsCount);
+    const auto padding = m_config.padding * 2u;
+    const bool isWhole = m_config.lazyDecode;
+
+    std::vector<std::vector<uint32_t>> bands(bandsCount);
+    const auto count = getRectsCount();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto& rc = getRectByIndex(i);
+        const auto first = rc.top / bandHeight;
+        const auto last = isWhole
+            ? first
+            : std::min(bandsCount - 1u, (rc.bottom + padding - 1u) / bandHeight);
+        for (auto band = first; band <= last; band++)
+        {
+            bands[band].push_back(i);
+        }
+    }
+
+    workers.run(bandsCount, [&](uint32_t band, uint32_t worker) {
+        const auto top = band * bandHeight;
+        const auto bottom = top + bandHeight;
+        for (auto idx : bands[band])
+        {
+            const auto& rc = getRectByIndex(idx);
+            const auto boxBottom = rc.bottom + padding;
+            const auto begin = isWhole ? rc.top : std::max(top, rc.top);
+            const auto end = isWhole ? boxBottom : std::min(bottom, boxBottom);
+            copyBitmap(rc, getImageByIndex(idx), isRotatedByIndex(idx), *m_arenas[worker], begin - rc.top, end - rc.top);
+        }
+    });
+
+    return true;
+}
+
+sSize AtlasPacker::getUsedSize(const sSize& size) const
+{
+    const auto padding = m_config.padding * 2u;
+    const auto border = m_config.border;
+
+    // rect keeps sprite size from origin of padded box
+    uint32_t right = 0;
+    uint32_t bottom = 0;
+    const auto count = getRectsCount();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto& rc = getRectByIndex(i);
+        right = std::max(right, rc.right + padding);
+        bottom = std::max(bottom, rc.bottom + padding);
+    }
+
+    return {
+        std::min(size.width, cAtlasSize::FixSize(right + border, m_config.pot)),
+        std::min(size.height, cAtlasSize::FixSize(bottom + border, m_config.pot))
+    };
+}
+
+bool AtlasPacker::GenerateResFile(const char* name, const std::vector<sPage>& pages)
 {
     cFile file;
     if (file.open(name, "w"))
     {
         std::stringstream out;
 
-        const uint32_t rectsCount = getRectsCount();
-        std::vector<uint32_t> indexes(rectsCount);
-        for (uint32_t i = 0; i < rectsCount; i++)
+        // identical sprites share the rect of the packed one
+        struct sEntry
+        {
+            const cImage* image;
+            uint32_t page;
+            uint32_t idx;
+        };
+
+        std::vector<sEntry> entries;
+        for (uint32_t page = 0; page < pages.size(); page++)
         {
-            indexes[i] = i;
+            auto packer = pages[page].packer;
+            const uint32_t rectsCount = packer->getRectsCount();
+            entries.reserve(entries.size() + rectsCount);
+            for (uint32_t i = 0; i < rectsCount; i++)
+            {
+                auto image = packer->getImageByIndex(i);
+                entries.push_back({ image, page, i });
+                for (auto alias : image->getAliases())
+                {
+                    entries.push_back({ alias, page, i });
+                }
+            }
         }
 
-        std::sort(indexes.begin(), indexes.end(), [this](uint32_t a, uint32_t b) {
-            auto& na = getImageByIndex(a)->getName();
-            auto& nb = getImageByIndex(b)->getName();
-            return na < nb;
+        std::sort(entries.begin(), entries.end(), [](const sEntry& a, const sEntry& b) {
+            return a.image->getName() < b.image->getName();
         });
 
         out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
 
-        auto& bitmap = m_atlas;
-        auto& size = bitmap.getSize();
-        out << "<atlas width=\"" << size.width << "\" height=\"" << size.height << "\">\n";
+        const bool isMultipage = pages.size() > 1;
+        if (isMultipage)
+        {
+            out << "<atlas pages=\"" << pages.size() << "\">\n";
+            for (uint32_t page = 0; page < pages.size(); page++)
+            {
+                auto& size = pages[page].size;
+                out << "    <page id=\"" << page << "\" texture=\"" << pages[page].atlasName << "\" ";
+                out << "width=\"" << size.width << "\" height=\"" << size.height << "\" />\n";
+            }
+        }
+        else
+        {
+            auto& size = pages[0].size;
+            out << "<atlas width=\"" << size.width << "\" height=\"" << size.height << "\">\n";
+        }
 
-        for (uint32_t i = 0; i < rectsCount; i++)
+        for (const auto& entry : entries)
         {
-            const auto idx = indexes[i];
+            auto packer = pages[entry.page].packer;
+            const auto padding = packer->m_config.padding;
 
-            auto image = getImageByIndex(idx);
+            auto image = entry.image;
             auto& spriteId = image->getSpriteId();
 
-            const auto& rc = getRectByIndex(idx);
+            const auto& rc = packer->getRectByIndex(entry.idx);
             sOffset pos{
-                rc.left + m_config.padding,
-                rc.top + m_config.padding
+                rc.left + padding,
+                rc.top + padding
             };
             sSize size{
                 rc.width(),
@@ -237,8 +674,16 @@ bool AtlasPacker::generateResFile(const char* name, const char* atlasName)
             };
 
             out << "    ";
-            out << "<" << spriteId << " texture=\"" << atlasName << "\" ";
+            out << "<" << spriteId << " texture=\"" << pages[entry.page].atlasName << "\" ";
+            if (isMultipage)
+            {
+                out << "page=\"" << entry.page << "\" ";
+            }
             out << "rect=\"" << pos.x << " " << pos.y << " " << size.width << " " << size.height << "\" ";
+            if (packer->isRotatedByIndex(entry.idx))
+            {
+                out << "rotated=\"1\" ";
+            }
             out << "hotspot=\"" << hotspot.x << " " << hotspot.y << "\" />\n";
         }
         out << "</atlas>\n";
@@ -250,3 +695,58 @@ bool AtlasPacker::generateResFile(const char* name, const char* atlasName)
 
     return false;
 }
+
+bool AtlasPacker::GenerateStatsFile(const char* name, const std::vector<sPage>& pages)
+{
+    cFile file;
+    if (file.open(name, "w"))
+    {
+        std::stringstream out;
+
+        uint32_t totalSprites = 0u;
+        uint64_t totalArea = 0u;
+
+        out << "{\n";
+        out << "    \"pages\": [\n";
+        for (uint32_t page = 0; page < pages.size(); page++)
+        {
+            auto packer = pages[page].packer;
+            auto& size = pages[page].size;
+
+            // identical sprites are counted, but share the pixels
+            uint32_t sprites = 0u;
+            uint64_t area = 0u;
+            const uint32_t rectsCount = packer->getRectsCount();
+            for (uint32_t i = 0; i < rectsCount; i++)
+            {
+                const auto& rc = packer->getRectByIndex(i);
+                area += uint64_t(rc.width()) * rc.height();
+                sprites += 1u + static_cast<uint32_t>(packer->getImageByIndex(i)->getAliases().size());
+            }
+
+            const auto atlasArea = uint64_t(size.width) * size.height;
+            const auto fill = atlasArea != 0u ? 100.0 * area / atlasArea : 0.0;
+
+            out << "        { ";
+            out << "\"texture\": \"" << EscapeJson(pages[page].atlasName) << "\", ";
+            out << "\"width\": " << size.width << ", \"height\": " << size.height << ", ";
+            out << "\"sprites\": " << sprites << ", ";
+            out << "\"area\": " << area << ", ";
+            out << "\"fill\": " << static_cast<uint32_t>(fill * 100.0) / 100.0;
+            out << " }" << (page + 1 < pages.size() ? "," : "") << "\n";
+
+            totalSprites += sprites;
+            totalArea += area;
+        }
+        out << "    ],\n";
+        out << "    \"sprites\": " << totalSprites << ",\n";
+        out << "    \"area\": " << totalArea << "\n";
+        out << "}\n";
+
+        file.write((void*)out.str().c_str(), out.str().length());
+
+        return true;
+    }
+
+    return false;
+}
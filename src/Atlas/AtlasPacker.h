@@ -8,29 +8,62 @@
 
 #pragma once
 
+#include "Types/Allocator.h"
 #include "Types/Bitmap.h"
+#include "Types/Types.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 class cImage;
+class cWorkerPool;
+enum class Heuristic : uint32_t;
+enum class Method : uint32_t;
 struct sConfig;
-struct sRect;
-struct sSize;
 
 class AtlasPacker
 {
+public:
+    // orientation of a sprite requested by the caller
+    enum class Turn : uint32_t
+    {
+        Any,      // packer decides, only if rotation is allowed
+        None,     // as is
+        Clockwise // turned by 90 degrees clockwise
+    };
+
 public:
     static std::unique_ptr<AtlasPacker> create(uint32_t count, const sConfig& config);
 
+    static const char* GetMethodName(Method method);
+    static bool ParseMethod(const char* name, Method& method);
+
+    static const char* GetHeuristicName(Heuristic heuristic);
+    static bool ParseHeuristic(const char* name, Heuristic& heuristic);
+
+    struct sPage
+    {
+        const AtlasPacker* packer;
+        std::string atlasName;
+        sSize size;
+    };
+
+    // sprites of all pages in one description, page attribute is added for several pages
+    static bool GenerateResFile(const char* name, const std::vector<sPage>& pages);
+
+    // sizes, sprites count and fill of pages as JSON
+    static bool GenerateStatsFile(const char* name, const std::vector<sPage>& pages);
+
 public:
     AtlasPacker(const sConfig& config);
     virtual ~AtlasPacker();
 
     virtual bool compare(const cImage* a, const cImage* b) const = 0;
 
+    // layout only, the atlas bitmap is created by buildAtlas()
     virtual void setSize(const sSize& size) = 0;
-    virtual bool add(const cImage* image) = 0;
-    virtual void makeAtlas(bool overlay) = 0;
+    virtual bool add(const cImage* image, Turn turn) = 0;
 
     const cBitmap& getBitmap() const
     {
@@ -46,16 +79,29 @@ public:
     virtual const cImage* getImageByIndex(uint32_t idx) const = 0;
     virtual const sRect& getRectByIndex(uint32_t idx) const = 0;
 
-    void buildAtlas();
+    // sprite is turned by 90 degrees clockwise, rect has the turned size
+    virtual bool isRotatedByIndex(uint32_t idx) const = 0;
 
-    bool generateResFile(const char* name, const char* atlasName);
+    // extent of placed sprites with border, known without composing atlas
+    sSize getUsedSize(const sSize& size) const;
+
+    // Composes atlas in horizontal bands, several per worker thread.
+    // Returns false if memory for atlas can't be allocated.
+    bool buildAtlas(const sSize& size, const cWorkerPool& workers);
 
 protected:
-    void copyBitmap(const sRect& rc, const cImage* image, bool overlay);
+    bool createAtlas(const sSize& size);
+
+    // rows [begin, end) of padded sprite box, counted from its top
+    void copyBitmap(const sRect& rc, const cImage* image, bool rotated, cArenaAllocator& arena, uint32_t begin, uint32_t end);
+    void copyBitmap(const sRect& rc, const cBitmap& bmp, bool rotated, uint32_t begin, uint32_t end);
 
 protected:
     const sConfig& m_config;
 
 protected:
     cBitmap m_atlas;
+
+    // scratch memory for sprites decoded on demand, one per worker
+    std::vector<std::unique_ptr<cArenaAllocator>> m_arenas;
 };
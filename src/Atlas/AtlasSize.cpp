@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <utility>
 
 cAtlasSize::cAtlasSize(const sConfig& config)
     : m_config(config)
@@ -22,6 +23,12 @@ void cAtlasSize::addRect(const sSize& size)
     auto width = size.width + m_config.padding * 2u;
     auto height = size.height + m_config.padding * 2u;
 
+    // turned sprite needs its long side in one direction and short side in other
+    if (m_config.rotate && width < height)
+    {
+        std::swap(width, height);
+    }
+
     m_maxRectSize.width = std::max(m_maxRectSize.width, width);
     m_maxRectSize.height = std::max(m_maxRectSize.height, height);
 
@@ -67,6 +74,46 @@ bool cAtlasSize::isGood(const sSize& size) const
         && size.height <= m_config.maxTextureSize;
 }
 
+bool cAtlasSize::isReachable(const sSize& size) const
+{
+    // sprites can't fit if the largest one or their total area doesn't
+    const auto border = m_config.border * 2u;
+    if (size.width < border || size.height < border)
+    {
+        return false;
+    }
+
+    auto width = size.width - border;
+    auto height = size.height - border;
+    if (m_config.rotate && width < height)
+    {
+        std::swap(width, height);
+    }
+
+    return width >= m_maxRectSize.width
+        && height >= m_maxRectSize.height
+        && static_cast<uint64_t>(width) * height >= m_area;
+}
+
+sSize cAtlasSize::getAspect(const sSize& size, uint32_t aspect) const
+{
+    if (aspect == 0)
+    {
+        return size;
+    }
+    else if (aspect == 1)
+    {
+        return { size.height, size.width };
+    }
+
+    const auto area = static_cast<double>(size.width) * size.height;
+    const auto ratio = aspect == 2 ? 2.0 : 0.5;
+    const auto width = FixSize(static_cast<uint32_t>(std::sqrt(area * ratio)), m_config.pot);
+    const auto height = FixSize(static_cast<uint32_t>(std::ceil(area / width)), m_config.pot);
+
+    return { width, height };
+}
+
 uint32_t cAtlasSize::NextPot(uint32_t size)
 {
     size--;
@@ -23,6 +23,11 @@ public:
     sSize calcSize() const;
     sSize nextSize(const sSize& size, uint32_t step) const;
     bool isGood(const sSize& size) const;
+    bool isReachable(const sSize& size) const;
+
+    // 0 - size itself, others - transposed, twice wider and twice taller of same area
+    static const uint32_t AspectsCount = 4u;
+    sSize getAspect(const sSize& size, uint32_t aspect) const;
 
 public:
     static uint32_t NextPot(uint32_t i);
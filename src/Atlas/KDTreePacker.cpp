@@ -11,148 +11,25 @@
 #include "Image.h"
 #include "Types/Types.h"
 
-class cKDNode final
-{
-public:
-    cKDNode(const sRect& area, uint32_t padding)
-        : m_used(false)
-        , m_area(area)
-        , m_padding(padding)
-        , m_childA(nullptr)
-        , m_childB(nullptr)
-    {
-    }
-
-    ~cKDNode()
-    {
-        delete m_childA;
-        delete m_childB;
-    }
-
-    cKDNode* add(const sSize& size)
-    {
-        if (isLeaf())
-        {
-            // end of the tree, no more room
-            if (m_used)
-            {
-                return nullptr;
-            }
-
-            const auto padding = m_padding;
-
-            const auto imgWidth = size.width + padding * 2;
-            const auto imgHeight = size.height + padding * 2;
-
-            const auto nodeWidth = m_area.width();
-            const auto nodeHeight = m_area.height();
-
-            const auto x = m_area.left;
-            const auto y = m_area.top;
-            m_rect = { x, y, x + size.width, y + size.height };
-
-            // size matches exactly
-            if (imgWidth == nodeWidth && imgHeight == nodeHeight)
-            {
-                m_used = true;
-                return this;
-            }
-
-            // rect is too big for this node
-            if (imgWidth > nodeWidth || imgHeight > nodeHeight)
-            {
-                return nullptr;
-            }
-
-            // split this node in two
-            const auto subwidth = nodeWidth - imgWidth;
-            const auto subheight = nodeHeight - imgHeight;
-
-            // static int last = -1;
-            if (subwidth <= subheight)
-            {
-                // if (last != 0)
-                // {
-                // last = 0;
-                // printf("-"); fflush(nullptr);
-                // }
-                // split --
-                m_childA = new cKDNode({ x, y, x + nodeWidth, y + imgHeight }, padding);
-                m_childB = new cKDNode({ x, y + imgHeight, x + nodeWidth, y + imgHeight + subheight }, padding);
-            }
-            else
-            {
-                // if (last != 1)
-                // {
-                // last = 1;
-                // printf("|"); fflush(nullptr);
-                // }
-                // split |
-                m_childA = new cKDNode({ x, y, x + imgWidth, y + nodeHeight }, padding);
-                m_childB = new cKDNode({ x + imgWidth, y, x + imgWidth + subwidth, y + nodeHeight }, padding);
-            }
-
-            return m_childA->add(size);
-        }
-        else if (m_childA != nullptr)
-        {
-            auto node = m_childA->add(size);
-            if (node != nullptr)
-            {
-                return node;
-            }
-            else if (m_childB != nullptr)
-            {
-                return m_childB->add(size);
-            }
-        }
-
-        return nullptr;
-    }
-
-    const sRect& getRect() const
-    {
-        return m_rect;
-    }
-
-private:
-    bool isLeaf() const
-    {
-        return m_childA == nullptr || m_childB == nullptr;
-    }
-
-private:
-    bool m_used;
-    sRect m_area;
-    uint32_t m_padding;
+#include <algorithm>
+#include <utility>
 
-    cKDNode* m_childA; // left or top
-    cKDNode* m_childB; // right or bottom
-
-    sRect m_rect;
-};
-
-// ------------------------------------------------------------------------------
-//
-// ------------------------------------------------------------------------------
-
-KDTreePacker::KDTreePacker(const sConfig& config)
+KDTreePacker::KDTreePacker(uint32_t count, const sConfig& config)
     : AtlasPacker(config)
 {
+    // every placement adds at most two splits
+    m_tree.reserve(count * 4 + 1);
+    m_nodes.reserve(count);
 }
 
 KDTreePacker::~KDTreePacker(void)
 {
-    delete m_root;
 }
 
 bool KDTreePacker::compare(const cImage* a, const cImage* b) const
 {
-    auto& bmpa = a->getBitmap();
-    auto& sizea = bmpa.getSize();
-
-    auto& bmpb = b->getBitmap();
-    auto& sizeb = bmpb.getSize();
+    auto& sizea = a->getSize();
+    auto& sizeb = b->getSize();
 
 #if 0
 
@@ -226,35 +103,183 @@ void KDTreePacker::setSize(const sSize& size)
 {
     const auto border = m_config.border;
 
-    delete m_root;
-    m_root = new cKDNode({ border, border, size.width - border, size.height - border }, m_config.padding);
+    const sRect area{ border, border, size.width - border, size.height - border };
+
+    // nodes hold no resources, dropping the whole tree is O(1)
+    m_tree.clear();
+    m_tree.push_back({ area, 0u, 0u, area.width(), area.height(), false });
 
     m_nodes.clear();
-    m_atlas.createBitmap(size);
 }
 
-bool KDTreePacker::add(const cImage* image)
+bool KDTreePacker::fits(uint32_t idx, uint32_t width, uint32_t height) const
+{
+    const auto& node = m_tree[idx];
+    return width <= node.maxWidth && height <= node.maxHeight;
+}
+
+void KDTreePacker::split(uint32_t idx, uint32_t width, uint32_t height)
 {
-    auto& bmp = image->getBitmap();
-    auto& size = bmp.getSize();
-    auto node = m_root->add(size);
-    if (node != nullptr)
+    const auto area = m_tree[idx].area;
+
+    const auto x = area.left;
+    const auto y = area.top;
+
+    const auto nodeWidth = area.width();
+    const auto nodeHeight = area.height();
+
+    const auto subwidth = nodeWidth - width;
+    const auto subheight = nodeHeight - height;
+
+    sRect a;
+    sRect b;
+    if (subwidth <= subheight)
+    {
+        // split --
+        a = { x, y, x + nodeWidth, y + height };
+        b = { x, y + height, x + nodeWidth, y + height + subheight };
+    }
+    else
     {
-        m_nodes.push_back({ image, node });
+        // split |
+        a = { x, y, x + width, y + nodeHeight };
+        b = { x + width, y, x + width + subwidth, y + nodeHeight };
+    }
 
-        return true;
+    const auto childA = static_cast<uint32_t>(m_tree.size());
+    m_tree.push_back({ a, idx, 0u, a.width(), a.height(), false });
+    m_tree.push_back({ b, idx, 0u, b.width(), b.height(), false });
+    m_tree[idx].childA = childA;
+}
+
+bool KDTreePacker::insert(uint32_t idx, uint32_t width, uint32_t height, sRect& rc)
+{
+    // splitting a leaf always places the rect into the first child
+    while (true)
+    {
+        auto& node = m_tree[idx];
+        if (node.used || width > node.area.width() || height > node.area.height())
+        {
+            return false;
+        }
+
+        if (width == node.area.width() && height == node.area.height())
+        {
+            node.used = true;
+            node.maxWidth = 0;
+            node.maxHeight = 0;
+
+            rc = { node.area.left, node.area.top, node.area.left, node.area.top };
+            update(node.parent);
+
+            return true;
+        }
+
+        split(idx, width, height);
+        idx = m_tree[idx].childA;
+    }
+}
+
+void KDTreePacker::update(uint32_t idx)
+{
+    while (true)
+    {
+        auto& node = m_tree[idx];
+        if (node.childA != 0)
+        {
+            const auto& a = m_tree[node.childA];
+            const auto& b = m_tree[node.childA + 1];
+            node.maxWidth = std::max(a.maxWidth, b.maxWidth);
+            node.maxHeight = std::max(a.maxHeight, b.maxHeight);
+        }
+
+        if (idx == 0)
+        {
+            break;
+        }
+        idx = node.parent;
+    }
+}
+
+bool KDTreePacker::find(uint32_t width, uint32_t height, uint32_t& leaf)
+{
+    // depth-first, A before B, skipping subtrees without enough room
+    m_stack.clear();
+    m_stack.push_back(0u);
+    while (m_stack.empty() == false)
+    {
+        const auto idx = m_stack.back();
+        m_stack.pop_back();
+
+        if (fits(idx, width, height) == false)
+        {
+            continue;
+        }
+
+        const auto& node = m_tree[idx];
+        if (node.childA == 0)
+        {
+            if (node.used == false && width <= node.area.width() && height <= node.area.height())
+            {
+                leaf = idx;
+                return true;
+            }
+        }
+        else
+        {
+            m_stack.push_back(node.childA + 1);
+            m_stack.push_back(node.childA);
+        }
     }
 
     return false;
 }
 
-void KDTreePacker::makeAtlas(bool overlay)
+bool KDTreePacker::add(const cImage* image, Turn turn)
 {
-    for (const auto& piece : m_nodes)
+    const auto padding = m_config.padding;
+    auto& size = image->getSize();
+    auto width = size.width + padding * 2;
+    auto height = size.height + padding * 2;
+
+    bool rotated = turn == Turn::Clockwise;
+    if (rotated)
+    {
+        std::swap(width, height);
+    }
+
+    uint32_t leaf;
+    bool found = find(width, height, leaf);
+
+    // turned box is taken if it goes to a tighter leaf
+    uint32_t turnedLeaf;
+    if (m_config.rotate && turn == Turn::Any && width != height && find(height, width, turnedLeaf))
+    {
+        auto getScore = [this](uint32_t idx, uint32_t w, uint32_t h) -> std::pair<uint64_t, uint32_t> {
+            const auto& area = m_tree[idx].area;
+            return { uint64_t(area.width()) * area.height(), std::min(area.width() - w, area.height() - h) };
+        };
+
+        if (found == false || getScore(turnedLeaf, height, width) < getScore(leaf, width, height))
+        {
+            leaf = turnedLeaf;
+            std::swap(width, height);
+            found = true;
+            rotated = true;
+        }
+    }
+
+    sRect rc;
+    if (found && insert(leaf, width, height, rc))
     {
-        auto rc = piece.node->getRect();
-        copyBitmap(rc, piece.image, overlay);
+        rc.right += width - padding * 2;
+        rc.bottom += height - padding * 2;
+        m_nodes.push_back({ image, rc, rotated });
+
+        return true;
     }
+
+    return false;
 }
 
 uint32_t KDTreePacker::getRectsCount() const
@@ -269,5 +294,10 @@ const cImage* KDTreePacker::getImageByIndex(uint32_t idx) const
 
 const sRect& KDTreePacker::getRectByIndex(uint32_t idx) const
 {
-    return m_nodes[idx].node->getRect();
+    return m_nodes[idx].rc;
+}
+
+bool KDTreePacker::isRotatedByIndex(uint32_t idx) const
+{
+    return m_nodes[idx].rotated;
 }
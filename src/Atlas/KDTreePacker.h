@@ -9,34 +9,52 @@
 #pragma once
 
 #include "AtlasPacker.h"
+#include "Types/Types.h"
 
 #include <vector>
 
-class cKDNode;
-
 class KDTreePacker final : public AtlasPacker
 {
 public:
-    KDTreePacker(const sConfig& config);
+    KDTreePacker(uint32_t count, const sConfig& config);
     ~KDTreePacker();
 
     bool compare(const cImage* a, const cImage* b) const override;
 
     void setSize(const sSize& size) override;
-    bool add(const cImage* image) override;
-    void makeAtlas(bool overlay) override;
+    bool add(const cImage* image, Turn turn) override;
 
     uint32_t getRectsCount() const override;
     const cImage* getImageByIndex(uint32_t idx) const override;
     const sRect& getRectByIndex(uint32_t idx) const override;
+    bool isRotatedByIndex(uint32_t idx) const override;
+
+private:
+    bool fits(uint32_t idx, uint32_t width, uint32_t height) const;
+    bool find(uint32_t width, uint32_t height, uint32_t& leaf);
+    bool insert(uint32_t idx, uint32_t width, uint32_t height, sRect& rc);
+    void split(uint32_t idx, uint32_t width, uint32_t height);
+    void update(uint32_t idx);
 
 private:
-    cKDNode* m_root = nullptr;
+    // children are allocated in pairs, so B always follows A
+    struct sNode
+    {
+        sRect area;
+        uint32_t parent;
+        uint32_t childA; // left or top, 0 for leaf
+        uint32_t maxWidth; // largest free width in the subtree
+        uint32_t maxHeight; // largest free height in the subtree
+        bool used;
+    };
+    std::vector<sNode> m_tree;
+    std::vector<uint32_t> m_stack;
 
     struct sPiece
     {
         const cImage* image;
-        cKDNode* node;
+        sRect rc;
+        bool rotated;
     };
     std::vector<sPiece> m_nodes;
 };
@@ -0,0 +1,249 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "MaxRectsBin.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+    bool IsIntersect(const sRect& a, const sRect& b)
+    {
+        return a.left < b.right && b.left < a.right
+            && a.top < b.bottom && b.top < a.bottom;
+    }
+
+    bool IsContained(const sRect& a, const sRect& b)
+    {
+        return a.left >= b.left && a.top >= b.top
+            && a.right <= b.right && a.bottom <= b.bottom;
+    }
+
+    uint32_t CommonInterval(uint32_t a1, uint32_t a2, uint32_t b1, uint32_t b2)
+    {
+        return (a2 < b1 || b2 < a1)
+            ? 0u
+            : std::min(a2, b2) - std::max(a1, b1);
+    }
+
+} // namespace
+
+void cMaxRectsBin::reset(const sRect& area)
+{
+    m_area = area;
+
+    m_free.clear();
+    m_used.clear();
+    if (area.right > area.left && area.bottom > area.top)
+    {
+        m_free.push_back(area);
+    }
+}
+
+uint32_t cMaxRectsBin::getContactScore(const sRect& rc) const
+{
+    uint32_t score = 0u;
+
+    if (rc.left == m_area.left || rc.right == m_area.right)
+    {
+        score += rc.height();
+    }
+    if (rc.top == m_area.top || rc.bottom == m_area.bottom)
+    {
+        score += rc.width();
+    }
+
+    for (const auto& used : m_used)
+    {
+        if (used.left == rc.right || used.right == rc.left)
+        {
+            score += CommonInterval(used.top, used.bottom, rc.top, rc.bottom);
+        }
+        if (used.top == rc.bottom || used.bottom == rc.top)
+        {
+            score += CommonInterval(used.left, used.right, rc.left, rc.right);
+        }
+    }
+
+    return score;
+}
+
+cMaxRectsBin::sScore cMaxRectsBin::getScore(const sRect& freeRc, uint32_t width, uint32_t height, Heuristic heuristic) const
+{
+    const uint64_t leftoverHoriz = freeRc.width() - width;
+    const uint64_t leftoverVert = freeRc.height() - height;
+    const auto shortSide = std::min(leftoverHoriz, leftoverVert);
+    const auto longSide = std::max(leftoverHoriz, leftoverVert);
+
+    switch (heuristic)
+    {
+    case Heuristic::BestShortSideFit:
+        return { shortSide, longSide };
+
+    case Heuristic::BestLongSideFit:
+        return { longSide, shortSide };
+
+    case Heuristic::BestAreaFit:
+        return { uint64_t(freeRc.width()) * freeRc.height() - uint64_t(width) * height, shortSide };
+
+    case Heuristic::ContactPoint:
+        {
+            const sRect rc{ freeRc.left, freeRc.top, freeRc.left + width, freeRc.top + height };
+            // more contact is better
+            return { std::numeric_limits<uint32_t>::max() - uint64_t(getContactScore(rc)), shortSide };
+        }
+    }
+
+    return { shortSide, longSide };
+}
+
+bool cMaxRectsBin::find(uint32_t width, uint32_t height, Heuristic heuristic, bool canRotate, sRect& result) const
+{
+    bool found = false;
+    sScore best{ std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max() };
+
+    // square box looks the same turned
+    canRotate = canRotate && width != height;
+
+    for (const auto& freeRc : m_free)
+    {
+        if (width <= freeRc.width() && height <= freeRc.height())
+        {
+            auto score = getScore(freeRc, width, height, heuristic);
+            if (score < best)
+            {
+                best = score;
+                result = { freeRc.left, freeRc.top, freeRc.left + width, freeRc.top + height };
+                found = true;
+            }
+        }
+
+        // turned box wins only if it's strictly better
+        if (canRotate && height <= freeRc.width() && width <= freeRc.height())
+        {
+            auto score = getScore(freeRc, height, width, heuristic);
+            if (score < best)
+            {
+                best = score;
+                result = { freeRc.left, freeRc.top, freeRc.left + height, freeRc.top + width };
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+void cMaxRectsBin::place(const sRect& rc)
+{
+    m_new.clear();
+
+    for (size_t i = 0; i < m_free.size();)
+    {
+        if (IsIntersect(m_free[i], rc))
+        {
+            split(m_free[i], rc);
+
+            m_free[i] = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    prune();
+
+    m_used.push_back(rc);
+}
+
+bool cMaxRectsBin::insert(uint32_t width, uint32_t height, Heuristic heuristic, bool canRotate, sRect& result)
+{
+    if (find(width, height, heuristic, canRotate, result))
+    {
+        place(result);
+        return true;
+    }
+
+    return false;
+}
+
+void cMaxRectsBin::addFree(const sRect& rc)
+{
+    if (rc.right > rc.left && rc.bottom > rc.top)
+    {
+        m_free.push_back(rc);
+    }
+}
+
+void cMaxRectsBin::split(const sRect& freeRc, const sRect& used)
+{
+    // up to four maximal rectangles around the used one
+    if (used.left > freeRc.left)
+    {
+        m_new.push_back({ freeRc.left, freeRc.top, used.left, freeRc.bottom });
+    }
+    if (used.right < freeRc.right)
+    {
+        m_new.push_back({ used.right, freeRc.top, freeRc.right, freeRc.bottom });
+    }
+    if (used.top > freeRc.top)
+    {
+        m_new.push_back({ freeRc.left, freeRc.top, freeRc.right, used.top });
+    }
+    if (used.bottom < freeRc.bottom)
+    {
+        m_new.push_back({ freeRc.left, used.bottom, freeRc.right, freeRc.bottom });
+    }
+}
+
+void cMaxRectsBin::prune()
+{
+    // new rectangles against each other
+    for (size_t i = 0; i < m_new.size(); i++)
+    {
+        for (size_t j = i + 1; j < m_new.size();)
+        {
+            if (IsContained(m_new[j], m_new[i]))
+            {
+                m_new[j] = m_new.back();
+                m_new.pop_back();
+            }
+            else if (IsContained(m_new[i], m_new[j]))
+            {
+                m_new[i] = m_new[j];
+                m_new[j] = m_new.back();
+                m_new.pop_back();
+                j = i + 1;
+            }
+            else
+            {
+                j++;
+            }
+        }
+    }
+
+    // old free rectangle can't be inside a new one, it would be inside the split one too
+    const auto oldCount = m_free.size();
+    for (const auto& rc : m_new)
+    {
+        bool isContained = false;
+        for (size_t i = 0; i < oldCount && isContained == false; i++)
+        {
+            isContained = IsContained(rc, m_free[i]);
+        }
+
+        if (isContained == false)
+        {
+            m_free.push_back(rc);
+        }
+    }
+}
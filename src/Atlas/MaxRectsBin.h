@@ -0,0 +1,62 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "Config.h"
+#include "Types/Types.h"
+
+#include <vector>
+
+// Maximal free rectangles of a bin. The free list never holds a rectangle
+// contained in another one, so after a split only the new rectangles need
+// to be checked for containment.
+class cMaxRectsBin final
+{
+public:
+    void reset(const sRect& area);
+
+    // Finds position for a box of given size, doesn't change the bin.
+    // Box may be turned by 90 degrees if canRotate, result has the placed size then.
+    bool find(uint32_t width, uint32_t height, Heuristic heuristic, bool canRotate, sRect& result) const;
+    void place(const sRect& rc);
+
+    bool insert(uint32_t width, uint32_t height, Heuristic heuristic, bool canRotate, sRect& result);
+
+    // Returns area to the bin without any overlap check.
+    void addFree(const sRect& rc);
+
+    bool isEmpty() const
+    {
+        return m_free.empty();
+    }
+
+private:
+    struct sScore
+    {
+        uint64_t primary;
+        uint64_t secondary;
+
+        bool operator<(const sScore& other) const
+        {
+            return primary < other.primary
+                || (primary == other.primary && secondary < other.secondary);
+        }
+    };
+
+    sScore getScore(const sRect& freeRc, uint32_t width, uint32_t height, Heuristic heuristic) const;
+    uint32_t getContactScore(const sRect& rc) const;
+    void split(const sRect& freeRc, const sRect& used);
+    void prune();
+
+private:
+    sRect m_area;
+    std::vector<sRect> m_free;
+    std::vector<sRect> m_new;
+    std::vector<sRect> m_used;
+};
@@ -0,0 +1,97 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "MaxRectsPacker.h"
+#include "Config.h"
+#include "Image.h"
+#include "Types/Types.h"
+
+#include <algorithm>
+
+MaxRectsPacker::MaxRectsPacker(uint32_t count, const sConfig& config)
+    : AtlasPacker(config)
+{
+    m_images.reserve(count);
+}
+
+MaxRectsPacker::~MaxRectsPacker()
+{
+}
+
+bool MaxRectsPacker::compare(const cImage* a, const cImage* b) const
+{
+    auto& sizea = a->getSize();
+    auto& sizeb = b->getSize();
+
+    // longer side first, then shorter side
+    auto maxa = std::max(sizea.width, sizea.height);
+    auto maxb = std::max(sizeb.width, sizeb.height);
+    if (maxa != maxb)
+    {
+        return maxa > maxb;
+    }
+
+    return std::min(sizea.width, sizea.height) > std::min(sizeb.width, sizeb.height);
+}
+
+void MaxRectsPacker::setSize(const sSize& size)
+{
+    const auto border = m_config.border;
+
+    m_bin.reset({ border, border, size.width - border, size.height - border });
+
+    m_images.clear();
+}
+
+bool MaxRectsPacker::add(const cImage* image, Turn turn)
+{
+    const auto padding = m_config.padding;
+    auto& size = image->getSize();
+
+    auto width = size.width + padding * 2;
+    auto height = size.height + padding * 2;
+    if (turn == Turn::Clockwise)
+    {
+        std::swap(width, height);
+    }
+
+    const bool canRotate = m_config.rotate && turn == Turn::Any;
+
+    sRect rc;
+    if (m_bin.insert(width, height, m_config.heuristic, canRotate, rc))
+    {
+        const bool rotated = (turn == Turn::Clockwise) != (rc.width() != width);
+        rc.right -= padding * 2;
+        rc.bottom -= padding * 2;
+        m_images.push_back({ image, rc, rotated });
+
+        return true;
+    }
+
+    return false;
+}
+
+uint32_t MaxRectsPacker::getRectsCount() const
+{
+    return (uint32_t)m_images.size();
+}
+
+const cImage* MaxRectsPacker::getImageByIndex(uint32_t idx) const
+{
+    return m_images[idx].image;
+}
+
+const sRect& MaxRectsPacker::getRectByIndex(uint32_t idx) const
+{
+    return m_images[idx].rc;
+}
+
+bool MaxRectsPacker::isRotatedByIndex(uint32_t idx) const
+{
+    return m_images[idx].rotated;
+}
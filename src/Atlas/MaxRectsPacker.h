@@ -0,0 +1,43 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "AtlasPacker.h"
+#include "MaxRectsBin.h"
+#include "Types/Types.h"
+
+#include <vector>
+
+class MaxRectsPacker final : public AtlasPacker
+{
+public:
+    MaxRectsPacker(uint32_t count, const sConfig& config);
+    ~MaxRectsPacker();
+
+    bool compare(const cImage* a, const cImage* b) const override;
+
+    void setSize(const sSize& size) override;
+    bool add(const cImage* image, Turn turn) override;
+
+    uint32_t getRectsCount() const override;
+    const cImage* getImageByIndex(uint32_t idx) const override;
+    const sRect& getRectByIndex(uint32_t idx) const override;
+    bool isRotatedByIndex(uint32_t idx) const override;
+
+private:
+    cMaxRectsBin m_bin;
+
+    struct sPiece
+    {
+        const cImage* image;
+        sRect rc;
+        bool rotated;
+    };
+    std::vector<sPiece> m_images;
+};
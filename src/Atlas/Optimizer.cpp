@@ -0,0 +1,310 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "Optimizer.h"
+#include "AtlasSize.h"
+#include "Image.h"
+#include "Utils.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+
+    // splitmix64, same sequence on every platform
+    class cRandom final
+    {
+    public:
+        explicit cRandom(uint64_t seed)
+            : m_state(seed)
+        {
+        }
+
+        uint64_t next()
+        {
+            uint64_t z = (m_state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+        uint32_t next(uint32_t count)
+        {
+            return static_cast<uint32_t>(next() % count);
+        }
+
+        double nextUnit()
+        {
+            return (next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+    private:
+        uint64_t m_state;
+    };
+
+    // temperature falls from mean sprite area by 100 times, then reheats
+    const uint32_t CoolingPeriod = 256u;
+    const double CoolingRange = 0.01;
+
+    uint64_t getArea(const sSize& size)
+    {
+        return uint64_t(size.width) * size.height;
+    }
+
+} // namespace
+
+cOptimizer::cOptimizer(const sConfig& config, const cAtlasSize& sizeCalculator, const sSize& size)
+    : m_config(config)
+    , m_sizeCalculator(sizeCalculator)
+    , m_size(size)
+{
+    const auto area = getArea(size);
+
+    // same steps as size search walks, with other aspect ratios of each
+    for (auto s = sizeCalculator.calcSize(); getArea(s) < area; s = sizeCalculator.nextSize(s, 1u))
+    {
+        for (uint32_t a = 0; a < cAtlasSize::AspectsCount; a++)
+        {
+            const auto target = sizeCalculator.getAspect(s, a);
+            if (getArea(target) < area
+                && sizeCalculator.isGood(target)
+                && sizeCalculator.isReachable(target))
+            {
+                m_targets.push_back(target);
+            }
+        }
+    }
+
+    std::stable_sort(m_targets.begin(), m_targets.end(), [](const sSize& a, const sSize& b) -> bool {
+        return getArea(a) > getArea(b);
+    });
+    m_targets.erase(std::unique(m_targets.begin(), m_targets.end(), [](const sSize& a, const sSize& b) -> bool {
+                        return a.width == b.width && a.height == b.height;
+                    }),
+                    m_targets.end());
+}
+
+cOptimizer::~cOptimizer()
+{
+}
+
+bool cOptimizer::isFilled(const sSize& size) const
+{
+    return m_config.targetFill != 0u
+        && uint64_t(m_sizeCalculator.getArea()) * 100u >= getArea(size) * m_config.targetFill;
+}
+
+uint64_t cOptimizer::evaluate(AtlasPacker* packer, const std::vector<cImage*>& images, const sState& state, const sSize& size) const
+{
+    const auto padding = m_config.padding * 2u;
+
+    // area of sprites left out, zero if all fit
+    uint64_t unplaced = 0u;
+    packer->setSize(size);
+    for (auto idx : state.order)
+    {
+        auto image = images[idx];
+        if (packer->add(image, state.turns[idx]) == false)
+        {
+            auto& s = image->getSize();
+            unplaced += uint64_t(s.width + padding) * (s.height + padding);
+        }
+    }
+
+    return unplaced;
+}
+
+void cOptimizer::anneal(sChain& chain, const std::vector<cImage*>& images, uint64_t deadline) const
+{
+    const auto count = static_cast<uint32_t>(images.size());
+    const auto maxIterations = m_config.optimizeIterations;
+    auto packer = chain.packer.get();
+
+    cRandom random(chain.seed);
+
+    sState current;
+    current.order.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        current.order[i] = i;
+    }
+    current.turns.assign(count, Turn::Any);
+    chain.best = current;
+
+    const double startTemperature = double(m_sizeCalculator.getArea()) / count;
+
+    size_t target = 0;
+    uint64_t energy = evaluate(packer, images, current, m_targets[target]);
+
+    // all sprites fit, keep the layout and aim at next smaller size
+    auto advance = [&](uint32_t iterations) {
+        while (energy == 0u)
+        {
+            chain.best = current;
+            chain.size = m_targets[target];
+            chain.bestIteration = iterations;
+
+            target++;
+            if (target == m_targets.size() || isFilled(chain.size))
+            {
+                break;
+            }
+            energy = evaluate(packer, images, current, m_targets[target]);
+        }
+    };
+    advance(0u);
+
+    sState next;
+    uint32_t it = 0;
+    for (; count > 1 && target < m_targets.size() && isFilled(chain.size) == false; it++)
+    {
+        if ((maxIterations != 0u && it >= maxIterations)
+            || (deadline != 0u && getCurrentTime() > deadline))
+        {
+            break;
+        }
+
+        // swap two sprites, move one sprite to other place or change its orientation
+        next = current;
+        const auto move = random.next(m_config.rotate ? 10u : 6u);
+        const auto a = random.next(count);
+        if (move < 3u)
+        {
+            std::swap(next.order[a], next.order[random.next(count)]);
+        }
+        else if (move < 6u)
+        {
+            const auto b = random.next(count);
+            if (a < b)
+            {
+                std::rotate(next.order.begin() + a, next.order.begin() + a + 1, next.order.begin() + b + 1);
+            }
+            else
+            {
+                std::rotate(next.order.begin() + b, next.order.begin() + a, next.order.begin() + a + 1);
+            }
+        }
+        else
+        {
+            auto& turn = next.turns[next.order[a]];
+            if (turn == Turn::Any)
+            {
+                turn = random.next(2u) == 0u ? Turn::None : Turn::Clockwise;
+            }
+            else
+            {
+                turn = turn == Turn::None ? Turn::Clockwise : Turn::None;
+            }
+        }
+
+        const auto nextEnergy = evaluate(packer, images, next, m_targets[target]);
+
+        const double progress = double(it % CoolingPeriod) / CoolingPeriod;
+        const double temperature = startTemperature * std::pow(CoolingRange, progress);
+        const double chance = random.nextUnit();
+        if (nextEnergy <= energy
+            || chance < std::exp(-double(nextEnergy - energy) / temperature))
+        {
+            std::swap(current, next);
+            energy = nextEnergy;
+        }
+
+        advance(it + 1);
+    }
+
+    chain.iterations = it;
+}
+
+bool cOptimizer::run(const cWorkerPool& workers, const std::vector<cImage*>& images, uint64_t seed)
+{
+    if (m_targets.empty() || isFilled(m_size))
+    {
+        return false;
+    }
+
+    const auto chainsCount = workers.getThreadsCount();
+    m_chains.resize(chainsCount);
+    for (uint32_t i = 0; i < chainsCount; i++)
+    {
+        auto& chain = m_chains[i];
+        chain.seed = seed + i;
+        chain.packer = AtlasPacker::create(images.size(), m_config);
+        chain.size = m_size;
+        chain.iterations = 0u;
+        chain.bestIteration = 0u;
+    }
+
+    // seeded by packer's own order
+    auto sorted = images;
+    auto packer = m_chains[0].packer.get();
+    std::stable_sort(sorted.begin(), sorted.end(), [packer](const cImage* a, const cImage* b) -> bool {
+        return packer->compare(a, b);
+    });
+
+    const auto deadline = m_config.optimizeTime != 0u
+        ? getCurrentTime() + m_config.optimizeTime * 1000ull
+        : 0u;
+
+    workers.run(chainsCount, [&](uint32_t idx, uint32_t /*worker*/) {
+        anneal(m_chains[idx], sorted, deadline);
+    });
+
+    // smallest area wins, earlier chain on ties
+    bool found = false;
+    uint64_t bestArea = getArea(m_size);
+    for (uint32_t i = 0; i < chainsCount; i++)
+    {
+        const auto& chain = m_chains[i];
+        const auto area = getArea(chain.size);
+        ::printf(" - chain %u (seed %llu): %u x %u at iteration %u of %u.\n",
+                 i,
+                 static_cast<unsigned long long>(chain.seed),
+                 chain.size.width,
+                 chain.size.height,
+                 chain.bestIteration,
+                 chain.iterations);
+        if (area < bestArea)
+        {
+            found = true;
+            bestArea = area;
+            m_winner = i;
+        }
+    }
+
+    if (found)
+    {
+        // packer holds the last tried layout, repeat the best one
+        auto& chain = m_chains[m_winner];
+        evaluate(chain.packer.get(), sorted, chain.best, chain.size);
+    }
+
+    return found;
+}
+
+AtlasPacker* cOptimizer::getPacker() const
+{
+    return m_chains[m_winner].packer.get();
+}
+
+const sSize& cOptimizer::getSize() const
+{
+    return m_chains[m_winner].size;
+}
+
+uint64_t cOptimizer::getSeed() const
+{
+    return m_chains[m_winner].seed;
+}
+
+uint32_t cOptimizer::getIterations() const
+{
+    return m_chains[m_winner].bestIteration;
+}
@@ -0,0 +1,77 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "AtlasPacker.h"
+#include "Config.h"
+#include "Types/Types.h"
+
+#include <memory>
+#include <vector>
+
+class cAtlasSize;
+class cImage;
+class cWorkerPool;
+
+// Simulated annealing over insertion order and sprite orientations. Each worker
+// runs its own chain seeded by seed + chain index, a chain tries to squeeze all
+// sprites into the next smaller candidate size than its best one. Result of a
+// chain depends only on its seed and iterations count, so the winner can be
+// replayed with a single thread.
+class cOptimizer final
+{
+public:
+    cOptimizer(const sConfig& config, const cAtlasSize& sizeCalculator, const sSize& size);
+    ~cOptimizer();
+
+    // Stops at deadline, iterations limit per chain or target fill percent.
+    // Returns true if smaller atlas was found.
+    bool run(const cWorkerPool& workers, const std::vector<cImage*>& images, uint64_t seed);
+
+    AtlasPacker* getPacker() const;
+    const sSize& getSize() const;
+
+    // replays the winner with a single thread
+    uint64_t getSeed() const;
+    uint32_t getIterations() const;
+
+private:
+    using Turn = AtlasPacker::Turn;
+
+    struct sState
+    {
+        std::vector<uint32_t> order;
+        std::vector<Turn> turns;
+    };
+
+    struct sChain
+    {
+        uint64_t seed;
+        std::unique_ptr<AtlasPacker> packer;
+        sState best;
+        sSize size;
+        uint32_t iterations; // done before stop
+        uint32_t bestIteration; // iterations needed to reach the best
+    };
+
+    void anneal(sChain& chain, const std::vector<cImage*>& images, uint64_t deadline) const;
+    uint64_t evaluate(AtlasPacker* packer, const std::vector<cImage*>& images, const sState& state, const sSize& size) const;
+    bool isFilled(const sSize& size) const;
+
+private:
+    const sConfig& m_config;
+    const cAtlasSize& m_sizeCalculator;
+
+    // candidate sizes smaller than initial one, largest first
+    std::vector<sSize> m_targets;
+    sSize m_size;
+
+    std::vector<sChain> m_chains;
+    uint32_t m_winner = 0u;
+};
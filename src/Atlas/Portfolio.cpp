@@ -0,0 +1,392 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "Portfolio.h"
+#include "AtlasPacker.h"
+#include "AtlasSize.h"
+#include "Image.h"
+#include "SizeSearch.h"
+#include "Utils.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+    struct sSortKeyName
+    {
+        cPortfolio::SortKey sortKey;
+        const char* name;
+    };
+
+    const sSortKeyName SortKeyNames[] = {
+        { cPortfolio::SortKey::Packer, "packer" },
+        { cPortfolio::SortKey::Area, "area" },
+        { cPortfolio::SortKey::MaxSide, "maxside" },
+        { cPortfolio::SortKey::Height, "height" },
+        { cPortfolio::SortKey::Width, "width" },
+        { cPortfolio::SortKey::Perimeter, "perimeter" },
+    };
+
+    bool ParseSortKey(const std::string& name, cPortfolio::SortKey& sortKey)
+    {
+        for (auto& k : SortKeyNames)
+        {
+            if (name == k.name)
+            {
+                sortKey = k.sortKey;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    const char* GetSortKeyName(cPortfolio::SortKey sortKey)
+    {
+        for (auto& k : SortKeyNames)
+        {
+            if (k.sortKey == sortKey)
+            {
+                return k.name;
+            }
+        }
+
+        return "unknown";
+    }
+
+    // bigger sprites go first, equal ones keep file order
+    void Sort(std::vector<cImage*>& images, cPortfolio::SortKey sortKey, const AtlasPacker* packer)
+    {
+        auto key = [sortKey](const cImage* image) -> std::pair<uint64_t, uint64_t> {
+            auto& size = image->getSize();
+            const uint64_t w = size.width;
+            const uint64_t h = size.height;
+
+            switch (sortKey)
+            {
+            case cPortfolio::SortKey::Packer:
+            case cPortfolio::SortKey::Area:
+                return { w * h, std::max(w, h) };
+
+            case cPortfolio::SortKey::MaxSide:
+                return { std::max(w, h), w * h };
+
+            case cPortfolio::SortKey::Height:
+                return { h, w };
+
+            case cPortfolio::SortKey::Width:
+                return { w, h };
+
+            case cPortfolio::SortKey::Perimeter:
+                return { w + h, w * h };
+            }
+
+            return { w * h, std::max(w, h) };
+        };
+
+        if (sortKey == cPortfolio::SortKey::Packer)
+        {
+            std::stable_sort(images.begin(), images.end(), [packer](const cImage* a, const cImage* b) -> bool {
+                return packer->compare(a, b);
+            });
+        }
+        else
+        {
+            std::stable_sort(images.begin(), images.end(), [&key](const cImage* a, const cImage* b) -> bool {
+                return key(a) > key(b);
+            });
+        }
+    }
+
+    bool Pack(AtlasPacker* packer, const std::vector<cImage*>& images, const sSize& size)
+    {
+        packer->setSize(size);
+        for (auto image : images)
+        {
+            if (packer->add(image, AtlasPacker::Turn::Any) == false)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+} // namespace
+
+void cPortfolio::GetDefault(const sConfig& config, std::vector<sEntry>& entries)
+{
+    const struct
+    {
+        Method method;
+        Heuristic heuristic;
+    } Packers[] = {
+        { Method::KDTree, Heuristic::BestShortSideFit },
+        { Method::MaxRects, Heuristic::BestShortSideFit },
+        { Method::MaxRects, Heuristic::BestAreaFit },
+        { Method::Skyline, Heuristic::BestShortSideFit },
+    };
+
+    const SortKey SortKeys[] = {
+        SortKey::Packer,
+        SortKey::Area,
+        SortKey::MaxSide,
+        SortKey::Height,
+    };
+
+    for (auto rotate : { false, true })
+    {
+        if (rotate && config.rotate == false)
+        {
+            break;
+        }
+
+        for (auto& p : Packers)
+        {
+            for (auto sortKey : SortKeys)
+            {
+                entries.push_back({ p.method, p.heuristic, sortKey, rotate });
+            }
+        }
+    }
+}
+
+bool cPortfolio::Parse(const char* spec, const sConfig& config, std::vector<sEntry>& entries)
+{
+    bool result = true;
+
+    std::string list = spec;
+    size_t start = 0;
+    while (start <= list.length())
+    {
+        auto end = list.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = list.length();
+        }
+
+        const auto item = list.substr(start, end - start);
+        start = end + 1;
+        if (item.empty())
+        {
+            continue;
+        }
+
+        sEntry entry{ config.method, config.heuristic, SortKey::Packer, config.rotate };
+        bool isValid = true;
+
+        size_t pos = 0;
+        for (uint32_t field = 0; isValid && pos <= item.length(); field++)
+        {
+            auto next = item.find(':', pos);
+            if (next == std::string::npos)
+            {
+                next = item.length();
+            }
+
+            const auto name = item.substr(pos, next - pos);
+            pos = next + 1;
+
+            if (field == 0)
+            {
+                isValid = AtlasPacker::ParseMethod(name.c_str(), entry.method)
+                    && entry.method != Method::Best;
+            }
+            else if (name == "rotate")
+            {
+                entry.rotate = true;
+            }
+            else if (ParseSortKey(name, entry.sortKey) == false)
+            {
+                isValid = AtlasPacker::ParseHeuristic(name.c_str(), entry.heuristic);
+            }
+        }
+
+        if (isValid)
+        {
+            entries.push_back(entry);
+        }
+        else
+        {
+            ::printf("(WW) Unknown portfolio entry '%s'.\n", item.c_str());
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+std::string cPortfolio::GetName(const sEntry& entry)
+{
+    std::string name = AtlasPacker::GetMethodName(entry.method);
+    if (entry.method == Method::MaxRects)
+    {
+        name += ":";
+        name += AtlasPacker::GetHeuristicName(entry.heuristic);
+    }
+
+    name += ":";
+    name += GetSortKeyName(entry.sortKey);
+
+    if (entry.rotate)
+    {
+        name += ":rotate";
+    }
+
+    return name;
+}
+
+cPortfolio::cPortfolio(const sConfig& config, const std::vector<sEntry>& entries)
+    : m_candidates(entries.size())
+{
+    // packers keep reference to config, so candidates are never moved after this
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        auto& candidate = m_candidates[i];
+        candidate.entry = entries[i];
+        candidate.config = config;
+        candidate.config.method = entries[i].method;
+        candidate.config.heuristic = entries[i].heuristic;
+        candidate.config.rotate = entries[i].rotate;
+        candidate.config.speculative = false;
+        candidate.probes = 0u;
+        candidate.state = State::Skipped;
+    }
+}
+
+cPortfolio::~cPortfolio()
+{
+}
+
+void cPortfolio::pack(sCandidate& candidate, const std::vector<cImage*>& images, uint64_t deadline, bool isFirst) const
+{
+    auto isExpired = [&]() -> bool {
+        return isFirst == false && getCurrentTime() > deadline;
+    };
+
+    if (isExpired())
+    {
+        return;
+    }
+
+    const auto& config = candidate.config;
+    candidate.packer = AtlasPacker::create(images.size(), config);
+    auto packer = candidate.packer.get();
+
+    auto sorted = images;
+    Sort(sorted, candidate.entry.sortKey, packer);
+
+    cAtlasSize sizeCalculator(config);
+    for (auto image : sorted)
+    {
+        sizeCalculator.addRect(image->getSize());
+    }
+
+    cSizeSearch search(sizeCalculator, false);
+    bool isDropped = false;
+    sSize lastProbe;
+    auto probe = [&](const std::vector<sSize>& sizes, std::vector<char>& fits) {
+        if (isDropped || isExpired())
+        {
+            isDropped = true;
+            return;
+        }
+
+        lastProbe = sizes[0];
+        fits[0] = Pack(packer, sorted, lastProbe);
+    };
+
+    auto& size = candidate.size;
+    const bool isFound = search.find(probe, 1u, size);
+    candidate.probes = search.getProbesCount();
+
+    if (isDropped)
+    {
+        candidate.state = State::Skipped;
+    }
+    else if (isFound == false)
+    {
+        candidate.state = State::Failed;
+    }
+    else
+    {
+        if (lastProbe.width != size.width || lastProbe.height != size.height)
+        {
+            Pack(packer, sorted, size);
+        }
+        candidate.state = State::Done;
+    }
+}
+
+bool cPortfolio::run(const cWorkerPool& workers, const std::vector<cImage*>& images, uint32_t budgetMs)
+{
+    const auto deadline = getCurrentTime() + budgetMs * 1000ull;
+
+    workers.run((uint32_t)m_candidates.size(), [&](uint32_t idx, uint32_t /*worker*/) {
+        pack(m_candidates[idx], images, deadline, idx == 0);
+    });
+
+    // smallest area wins, earlier entry on ties
+    bool found = false;
+    uint64_t bestArea = 0u;
+    for (uint32_t i = 0; i < m_candidates.size(); i++)
+    {
+        const auto& candidate = m_candidates[i];
+        const auto name = GetName(candidate.entry);
+        switch (candidate.state)
+        {
+        case State::Skipped:
+            ::printf(" - %s: out of time budget.\n", name.c_str());
+            break;
+
+        case State::Failed:
+            ::printf(" - %s: doesn't fit.\n", name.c_str());
+            break;
+
+        case State::Done:
+            {
+                const auto& size = candidate.size;
+                const auto area = uint64_t(size.width) * size.height;
+                ::printf(" - %s: %u x %u in %u probes.\n", name.c_str(), size.width, size.height, candidate.probes);
+                if (found == false || area < bestArea)
+                {
+                    found = true;
+                    bestArea = area;
+                    m_winner = i;
+                }
+            }
+            break;
+        }
+    }
+
+    return found;
+}
+
+const cPortfolio::sEntry& cPortfolio::getWinner() const
+{
+    return m_candidates[m_winner].entry;
+}
+
+const sConfig& cPortfolio::getConfig() const
+{
+    return m_candidates[m_winner].config;
+}
+
+AtlasPacker* cPortfolio::getPacker() const
+{
+    return m_candidates[m_winner].packer.get();
+}
+
+const sSize& cPortfolio::getSize() const
+{
+    return m_candidates[m_winner].size;
+}
@@ -0,0 +1,90 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "Config.h"
+#include "Types/Types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class AtlasPacker;
+class cImage;
+class cWorkerPool;
+
+// Packs the same sprites with several packer, sort order and rotation
+// combinations, the one with the smallest atlas wins.
+class cPortfolio final
+{
+public:
+    enum class SortKey : uint32_t
+    {
+        Packer, // packer's own compare()
+        Area,
+        MaxSide,
+        Height,
+        Width,
+        Perimeter,
+    };
+
+    struct sEntry
+    {
+        Method method;
+        Heuristic heuristic;
+        SortKey sortKey;
+        bool rotate;
+    };
+
+    // Rotated combinations are added only if -rotate is set.
+    static void GetDefault(const sConfig& config, std::vector<sEntry>& entries);
+
+    // Comma separated entries of colon separated fields: packing method,
+    // then sort key, maxrects heuristic or 'rotate' in any order,
+    // e.g. "kdtree:area:rotate,maxrects:baf:height".
+    static bool Parse(const char* spec, const sConfig& config, std::vector<sEntry>& entries);
+
+    static std::string GetName(const sEntry& entry);
+
+public:
+    cPortfolio(const sConfig& config, const std::vector<sEntry>& entries);
+    ~cPortfolio();
+
+    // First entry always runs to the end, others are dropped once budget is over.
+    bool run(const cWorkerPool& workers, const std::vector<cImage*>& images, uint32_t budgetMs);
+
+    const sEntry& getWinner() const;
+    const sConfig& getConfig() const;
+    AtlasPacker* getPacker() const;
+    const sSize& getSize() const;
+
+private:
+    enum class State
+    {
+        Skipped,
+        Failed,
+        Done,
+    };
+
+    struct sCandidate
+    {
+        sEntry entry;
+        sConfig config;
+        std::unique_ptr<AtlasPacker> packer;
+        sSize size;
+        uint32_t probes;
+        State state;
+    };
+
+    void pack(sCandidate& candidate, const std::vector<cImage*>& images, uint64_t deadline, bool isFirst) const;
+
+private:
+    std::vector<sCandidate> m_candidates;
+    uint32_t m_winner = 0u;
+};
@@ -11,6 +11,16 @@
 #include "Image.h"
 #include "Types/Types.h"
 
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+    const uint32_t Empty = ~0u;
+
+} // namespace
+
 SimplePacker::SimplePacker(uint32_t count, const sConfig& config)
     : AtlasPacker(config)
 {
@@ -23,50 +33,89 @@ SimplePacker::~SimplePacker()
 
 bool SimplePacker::compare(const cImage* a, const cImage* b) const
 {
-    auto& bmpa = a->getBitmap();
-    auto& bmpb = b->getBitmap();
-    auto& sizea = bmpa.getSize();
-    auto& sizeb = bmpb.getSize();
+    auto& sizea = a->getSize();
+    auto& sizeb = b->getSize();
     return (sizea.width * sizea.height > sizeb.width * sizeb.height)
         && (sizea.width + sizea.height > sizeb.width + sizeb.height);
 }
 
-bool SimplePacker::add(const cImage* image)
+bool SimplePacker::add(const cImage* image, Turn turn)
 {
-    const auto& bmp = image->getBitmap();
-
-    const auto border = m_config.border;
     const auto padding = m_config.padding;
 
-    auto& atlasSize = m_atlas.getSize();
-    auto& bmpSize = bmp.getSize();
-    const auto width = atlasSize.width - bmpSize.width - border;
-    const auto height = atlasSize.height - bmpSize.height - border;
+    auto& bmpSize = image->getSize();
+    auto boxWidth = bmpSize.width + padding * 2;
+    auto boxHeight = bmpSize.height + padding * 2;
+
+    bool rotated = turn == Turn::Clockwise;
+    if (rotated)
+    {
+        std::swap(boxWidth, boxHeight);
+    }
+
+    sRect box;
+    bool found = findPosition(boxWidth, boxHeight, box);
+
+    // turned box is taken only if it goes strictly higher or lefter
+    if (m_config.rotate && turn == Turn::Any && boxWidth != boxHeight)
+    {
+        sRect turned;
+        if (findPosition(boxHeight, boxWidth, turned)
+            && (found == false
+                || turned.top < box.top
+                || (turned.top == box.top && turned.left < box.left)))
+        {
+            box = turned;
+            found = true;
+            rotated = true;
+        }
+    }
+
+    if (found)
+    {
+        const auto idx = static_cast<uint32_t>(m_images.size());
+        const sRect rc{ box.left, box.top, box.right - padding * 2, box.bottom - padding * 2 };
+        m_images.push_back({ image, rc, rotated, box });
+        addToGrid(idx);
+    }
 
-    sRect imgRc;
+    return found;
+}
 
-    for (uint32_t y = border; y < height;)
+bool SimplePacker::findPosition(uint32_t boxWidth, uint32_t boxHeight, sRect& box) const
+{
+    if (boxWidth > m_area.width() || boxHeight > m_area.height())
+    {
+        return false;
+    }
+
+    const auto width = m_area.right - boxWidth;
+    const auto height = m_area.bottom - boxHeight;
+
+    for (uint32_t y = m_area.top; y <= height;)
     {
-        imgRc.top = y;
-        imgRc.bottom = y + bmpSize.height;
+        box.top = y;
+        box.bottom = y + boxHeight;
+
+        // every blocker met in this row still blocks its x range until its bottom
+        uint32_t nextY = m_area.bottom;
 
-        for (uint32_t x = border; x < width;)
+        for (uint32_t x = m_area.left; x <= width;)
         {
-            imgRc.left = x;
-            imgRc.right = x + bmpSize.width;
+            box.left = x;
+            box.right = x + boxWidth;
 
-            const auto rc = checkRegion(imgRc);
+            const auto rc = checkRegion(box);
             if (rc == nullptr)
             {
-                // merge this region into the used region's vector
-                m_images.push_back({ image, imgRc });
-
                 return true;
             }
 
-            x += rc->width() + padding;
+            nextY = std::min(nextY, rc->bottom);
+            x = rc->right;
         }
-        y++;
+
+        y = nextY;
     }
 
     return false;
@@ -74,36 +123,74 @@ bool SimplePacker::add(const cImage* image)
 
 const sRect* SimplePacker::checkRegion(const sRect& region) const
 {
-    const auto padding = m_config.padding;
-    for (const auto& img : m_images)
+    // the blocker reaching furthest right gives the longest jump
+    const sRect* blocker = nullptr;
+
+    const auto col0 = region.left / m_cellSize;
+    const auto col1 = std::min((region.right - 1) / m_cellSize, m_cols - 1);
+    const auto row0 = region.top / m_cellSize;
+    const auto row1 = std::min((region.bottom - 1) / m_cellSize, m_rows - 1);
+
+    for (auto row = row0; row <= row1; row++)
     {
-        const auto& rc = img.rc;
-        if (region.left < rc.right + padding
-            && region.right + padding > rc.left
-            && region.top < rc.bottom + padding
-            && region.bottom + padding > rc.top)
+        for (auto col = col0; col <= col1; col++)
         {
-            return &rc;
+            for (auto link = m_cells[row * m_cols + col]; link != Empty; link = m_links[link].next)
+            {
+                const auto& rc = m_images[m_links[link].piece].box;
+                if (region.left < rc.right
+                    && region.right > rc.left
+                    && region.top < rc.bottom
+                    && region.bottom > rc.top
+                    && (blocker == nullptr || rc.right > blocker->right))
+                {
+                    blocker = &rc;
+                }
+            }
         }
     }
 
-    return nullptr;
+    return blocker;
 }
 
-void SimplePacker::setSize(const sSize& size)
+void SimplePacker::addToGrid(uint32_t idx)
 {
-    m_images.clear();
-    m_atlas.createBitmap(size);
-}
+    const auto& box = m_images[idx].box;
 
-void SimplePacker::makeAtlas(bool overlay)
-{
-    for (const auto& img : m_images)
+    const auto col0 = box.left / m_cellSize;
+    const auto col1 = std::min((box.right - 1) / m_cellSize, m_cols - 1);
+    const auto row0 = box.top / m_cellSize;
+    const auto row1 = std::min((box.bottom - 1) / m_cellSize, m_rows - 1);
+
+    for (auto row = row0; row <= row1; row++)
     {
-        copyBitmap(img.rc, img.image, overlay);
+        for (auto col = col0; col <= col1; col++)
+        {
+            auto& cell = m_cells[row * m_cols + col];
+            m_links.push_back({ idx, cell });
+            cell = static_cast<uint32_t>(m_links.size() - 1);
+        }
     }
 }
 
+void SimplePacker::setSize(const sSize& size)
+{
+    const auto border = m_config.border;
+
+    m_area = { border, border, size.width - border, size.height - border };
+
+    // about one sprite per cell once the atlas is full
+    const auto count = std::max<size_t>(m_images.capacity(), 1u);
+    const auto cellSize = std::sqrt(static_cast<double>(size.width) * size.height / count);
+    m_cellSize = std::min(std::max(static_cast<uint32_t>(cellSize), 8u), 256u);
+    m_cols = std::max((size.width + m_cellSize - 1) / m_cellSize, 1u);
+    m_rows = std::max((size.height + m_cellSize - 1) / m_cellSize, 1u);
+    m_cells.assign(m_cols * m_rows, Empty);
+    m_links.clear();
+
+    m_images.clear();
+}
+
 uint32_t SimplePacker::getRectsCount() const
 {
     return (uint32_t)m_images.size();
@@ -118,3 +205,8 @@ const sRect& SimplePacker::getRectByIndex(uint32_t idx) const
 {
     return m_images[idx].rc;
 }
+
+bool SimplePacker::isRotatedByIndex(uint32_t idx) const
+{
+    return m_images[idx].rotated;
+}
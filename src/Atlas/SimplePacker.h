@@ -22,21 +22,40 @@ public:
     bool compare(const cImage* a, const cImage* b) const override;
 
     void setSize(const sSize& size) override;
-    bool add(const cImage* image) override;
-    void makeAtlas(bool overlay) override;
+    bool add(const cImage* image, Turn turn) override;
 
     uint32_t getRectsCount() const override;
     const cImage* getImageByIndex(uint32_t idx) const override;
     const sRect& getRectByIndex(uint32_t idx) const override;
+    bool isRotatedByIndex(uint32_t idx) const override;
 
 private:
+    bool findPosition(uint32_t boxWidth, uint32_t boxHeight, sRect& box) const;
     const sRect* checkRegion(const sRect& region) const;
+    void addToGrid(uint32_t idx);
 
 private:
+    sRect m_area;
+
     struct sPiece
     {
         const cImage* image;
         sRect rc;
+        bool rotated;
+        sRect box; // padded
     };
     std::vector<sPiece> m_images;
+
+    // uniform grid over the atlas, each cell holds a list of overlapping pieces
+    uint32_t m_cellSize = 0;
+    uint32_t m_cols = 0;
+    uint32_t m_rows = 0;
+    std::vector<uint32_t> m_cells; // first link or Empty
+
+    struct sLink
+    {
+        uint32_t piece;
+        uint32_t next;
+    };
+    std::vector<sLink> m_links;
 };
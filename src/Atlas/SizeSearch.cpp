@@ -0,0 +1,179 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "SizeSearch.h"
+#include "AtlasSize.h"
+
+#include <algorithm>
+
+cSizeSearch::cSizeSearch(const cAtlasSize& sizeCalculator, bool aspects)
+{
+    const uint32_t count = aspects ? cAtlasSize::AspectsCount : 1u;
+    m_sequences.resize(count);
+
+    // width and height never shrink along the sequence,
+    // so anything below the lower bounds is a prefix of it
+    auto size = sizeCalculator.calcSize();
+    while (sizeCalculator.isGood(size))
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const auto s = sizeCalculator.getAspect(size, i);
+            if (sizeCalculator.isGood(s) && sizeCalculator.isReachable(s))
+            {
+                m_sequences[i].sizes.push_back(s);
+            }
+            else
+            {
+                m_skipped++;
+            }
+        }
+
+        size = sizeCalculator.nextSize(size, 8u);
+    }
+
+    m_oversize = size;
+}
+
+void cSizeSearch::addPoints(sSequence& seq, uint32_t count) const
+{
+    auto& indices = seq.indices;
+    indices.clear();
+
+    auto add = [&indices](uint32_t idx) {
+        if (indices.empty() || indices.back() != idx)
+        {
+            indices.push_back(idx);
+        }
+    };
+
+    const auto size = static_cast<uint32_t>(seq.sizes.size());
+    if (seq.step != 0)
+    {
+        // gallop: count points step apart
+        for (uint32_t i = 0; i < count; i++)
+        {
+            add(static_cast<uint32_t>(std::min<uint64_t>(seq.lo + uint64_t(seq.step) * (i + 1u) - 1u, size - 1u)));
+        }
+    }
+    else
+    {
+        // narrow [lo, hi) by count points spread evenly
+        const auto range = seq.hi - seq.lo;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            add(seq.lo + static_cast<uint32_t>(uint64_t(range) * (i + 1u) / (count + 1u)));
+        }
+    }
+}
+
+void cSizeSearch::update(sSequence& seq, const std::vector<char>& fits) const
+{
+    const auto& indices = seq.indices;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (fits[seq.first + i] != 0)
+        {
+            seq.hi = indices[i];
+            if (i > 0)
+            {
+                seq.lo = indices[i - 1] + 1u;
+            }
+            seq.step = 0u;
+            seq.done = seq.lo >= seq.hi;
+            return;
+        }
+    }
+
+    seq.lo = indices.back() + 1u;
+    if (seq.step != 0)
+    {
+        seq.step *= 2u;
+    }
+    seq.done = seq.lo >= std::min<uint32_t>(seq.hi, static_cast<uint32_t>(seq.sizes.size()));
+}
+
+bool cSizeSearch::find(const Probe& probe, uint32_t window, sSize& result)
+{
+    m_probes = 0u;
+    m_rounds = 0u;
+
+    uint32_t active = 0u;
+    for (auto& seq : m_sequences)
+    {
+        seq.lo = 0u;
+        seq.hi = static_cast<uint32_t>(seq.sizes.size());
+        seq.step = 1u;
+        seq.done = seq.sizes.empty();
+        if (seq.done == false)
+        {
+            active++;
+        }
+    }
+
+    std::vector<sSize> sizes;
+    std::vector<char> fits;
+
+    while (active != 0)
+    {
+        const auto count = std::max(window / active, 1u);
+
+        sizes.clear();
+        for (auto& seq : m_sequences)
+        {
+            if (seq.done == false)
+            {
+                addPoints(seq, count);
+
+                seq.first = static_cast<uint32_t>(sizes.size());
+                for (auto idx : seq.indices)
+                {
+                    sizes.push_back(seq.sizes[idx]);
+                }
+            }
+        }
+        fits.assign(sizes.size(), 0);
+
+        probe(sizes, fits);
+        m_probes += static_cast<uint32_t>(sizes.size());
+        m_rounds++;
+
+        active = 0u;
+        for (auto& seq : m_sequences)
+        {
+            if (seq.done == false)
+            {
+                update(seq, fits);
+                if (seq.done == false)
+                {
+                    active++;
+                }
+            }
+        }
+    }
+
+    // smallest area wins, earlier sequence on ties
+    bool found = false;
+    uint64_t bestArea = 0u;
+    for (const auto& seq : m_sequences)
+    {
+        if (seq.hi < seq.sizes.size())
+        {
+            const auto& size = seq.sizes[seq.hi];
+            const auto area = static_cast<uint64_t>(size.width) * size.height;
+            if (found == false || area < bestArea)
+            {
+                found = true;
+                bestArea = area;
+                result = size;
+            }
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,75 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "Types/Types.h"
+
+#include <functional>
+#include <vector>
+
+class cAtlasSize;
+
+class cSizeSearch final
+{
+public:
+    // fits[i] must be set for each of sizes, they may be packed in parallel
+    using Probe = std::function<void(const std::vector<sSize>& sizes, std::vector<char>& fits)>;
+
+    cSizeSearch(const cAtlasSize& sizeCalculator, bool aspects);
+
+    // Smallest size accepted by probe. Each aspect ratio keeps its own sequence,
+    // searched by galloping up from the first reachable size and narrowing down,
+    // window candidates per round are shared between sequences.
+    bool find(const Probe& probe, uint32_t window, sSize& result);
+
+    // first size over the limit, to report when nothing fits
+    const sSize& getOversize() const
+    {
+        return m_oversize;
+    }
+
+    uint32_t getProbesCount() const
+    {
+        return m_probes;
+    }
+
+    uint32_t getRoundsCount() const
+    {
+        return m_rounds;
+    }
+
+    uint32_t getSkippedCount() const
+    {
+        return m_skipped;
+    }
+
+private:
+    struct sSequence
+    {
+        std::vector<sSize> sizes;
+
+        uint32_t lo; // all below lo are known to fail
+        uint32_t hi; // known to fit if less than sizes count
+        uint32_t step; // gallop step, 0 once hi is known
+        bool done;
+
+        std::vector<uint32_t> indices; // probed in current round
+        uint32_t first; // offset of this round's probes in batch
+    };
+
+    void addPoints(sSequence& seq, uint32_t count) const;
+    void update(sSequence& seq, const std::vector<char>& fits) const;
+
+private:
+    std::vector<sSequence> m_sequences;
+    sSize m_oversize;
+    uint32_t m_probes = 0u;
+    uint32_t m_rounds = 0u;
+    uint32_t m_skipped = 0u;
+};
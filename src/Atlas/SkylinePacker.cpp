@@ -0,0 +1,236 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "SkylinePacker.h"
+#include "Config.h"
+#include "Image.h"
+#include "Types/Types.h"
+
+#include <algorithm>
+#include <limits>
+
+SkylinePacker::SkylinePacker(uint32_t count, const sConfig& config)
+    : AtlasPacker(config)
+{
+    m_images.reserve(count);
+}
+
+SkylinePacker::~SkylinePacker()
+{
+}
+
+bool SkylinePacker::compare(const cImage* a, const cImage* b) const
+{
+    auto& sizea = a->getSize();
+    auto& sizeb = b->getSize();
+
+    // taller first keeps the skyline flat
+    if (sizea.height != sizeb.height)
+    {
+        return sizea.height > sizeb.height;
+    }
+
+    return sizea.width > sizeb.width;
+}
+
+void SkylinePacker::setSize(const sSize& size)
+{
+    const auto border = m_config.border;
+
+    m_area = { border, border, size.width - border, size.height - border };
+
+    m_skyline.clear();
+    if (m_area.right > m_area.left && m_area.bottom > m_area.top)
+    {
+        m_skyline.push_back({ m_area.left, m_area.top, m_area.width() });
+    }
+
+    m_waste.reset({ 0u, 0u, 0u, 0u });
+
+    m_images.clear();
+}
+
+bool SkylinePacker::fitsAt(uint32_t nodeIdx, uint32_t width, uint32_t height, uint32_t& y) const
+{
+    const auto x = m_skyline[nodeIdx].x;
+    if (x + width > m_area.right)
+    {
+        return false;
+    }
+
+    y = m_skyline[nodeIdx].y;
+
+    uint32_t widthLeft = width;
+    for (auto i = nodeIdx; widthLeft > 0; i++)
+    {
+        const auto& node = m_skyline[i];
+        y = std::max(y, node.y);
+        if (y + height > m_area.bottom)
+        {
+            return false;
+        }
+
+        widthLeft -= std::min(widthLeft, node.width);
+    }
+
+    return true;
+}
+
+bool SkylinePacker::findPosition(uint32_t width, uint32_t height, bool canRotate, uint32_t& nodeIdx, sRect& result) const
+{
+    // bottom-left: the lowest top edge, then the narrowest segment
+    uint32_t bestBottom = std::numeric_limits<uint32_t>::max();
+    uint32_t bestWidth = std::numeric_limits<uint32_t>::max();
+    bool found = false;
+
+    // turned box is tried second, so it wins only if it's strictly better
+    const uint32_t orientations = canRotate && width != height ? 2u : 1u;
+
+    for (uint32_t i = 0, size = (uint32_t)m_skyline.size(); i < size; i++)
+    {
+        for (uint32_t o = 0; o < orientations; o++)
+        {
+            const auto w = o == 0 ? width : height;
+            const auto h = o == 0 ? height : width;
+
+            uint32_t y;
+            if (fitsAt(i, w, h, y))
+            {
+                const auto bottom = y + h;
+                const auto nodeWidth = m_skyline[i].width;
+                if (bottom < bestBottom || (bottom == bestBottom && nodeWidth < bestWidth))
+                {
+                    bestBottom = bottom;
+                    bestWidth = nodeWidth;
+                    nodeIdx = i;
+
+                    const auto x = m_skyline[i].x;
+                    result = { x, y, x + w, y + h };
+                    found = true;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+void SkylinePacker::addWaste(uint32_t nodeIdx, const sRect& rc)
+{
+    // gaps between the skyline and the bottom of the placed rect
+    for (auto i = nodeIdx; i < m_skyline.size(); i++)
+    {
+        const auto& node = m_skyline[i];
+        if (node.x >= rc.right)
+        {
+            break;
+        }
+
+        const auto left = node.x;
+        const auto right = std::min(node.x + node.width, rc.right);
+        if (node.y < rc.top)
+        {
+            m_waste.addFree({ left, node.y, right, rc.top });
+        }
+    }
+}
+
+void SkylinePacker::addLevel(uint32_t nodeIdx, const sRect& rc)
+{
+    m_skyline.insert(m_skyline.begin() + nodeIdx, { rc.left, rc.bottom, rc.width() });
+
+    // cut segments covered by the new one
+    for (auto i = nodeIdx + 1; i < m_skyline.size();)
+    {
+        auto& node = m_skyline[i];
+        if (node.x >= rc.right)
+        {
+            break;
+        }
+
+        const auto shrink = rc.right - node.x;
+        if (node.width <= shrink)
+        {
+            m_skyline.erase(m_skyline.begin() + i);
+        }
+        else
+        {
+            node.x += shrink;
+            node.width -= shrink;
+            break;
+        }
+    }
+
+    // merge neighbours on the same level
+    for (size_t i = 0; i + 1 < m_skyline.size();)
+    {
+        if (m_skyline[i].y == m_skyline[i + 1].y)
+        {
+            m_skyline[i].width += m_skyline[i + 1].width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+bool SkylinePacker::add(const cImage* image, Turn turn)
+{
+    const auto padding = m_config.padding;
+    auto& size = image->getSize();
+    auto width = size.width + padding * 2;
+    auto height = size.height + padding * 2;
+    if (turn == Turn::Clockwise)
+    {
+        std::swap(width, height);
+    }
+
+    const auto canRotate = m_config.rotate && turn == Turn::Any;
+
+    sRect rc;
+    if (m_waste.insert(width, height, Heuristic::BestShortSideFit, canRotate, rc) == false)
+    {
+        uint32_t nodeIdx;
+        if (findPosition(width, height, canRotate, nodeIdx, rc) == false)
+        {
+            return false;
+        }
+
+        addWaste(nodeIdx, rc);
+        addLevel(nodeIdx, rc);
+    }
+
+    const bool rotated = (turn == Turn::Clockwise) != (rc.width() != width);
+    rc.right -= padding * 2;
+    rc.bottom -= padding * 2;
+    m_images.push_back({ image, rc, rotated });
+
+    return true;
+}
+
+uint32_t SkylinePacker::getRectsCount() const
+{
+    return (uint32_t)m_images.size();
+}
+
+const cImage* SkylinePacker::getImageByIndex(uint32_t idx) const
+{
+    return m_images[idx].image;
+}
+
+const sRect& SkylinePacker::getRectByIndex(uint32_t idx) const
+{
+    return m_images[idx].rc;
+}
+
+bool SkylinePacker::isRotatedByIndex(uint32_t idx) const
+{
+    return m_images[idx].rotated;
+}
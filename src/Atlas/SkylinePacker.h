@@ -0,0 +1,61 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "AtlasPacker.h"
+#include "MaxRectsBin.h"
+#include "Types/Types.h"
+
+#include <vector>
+
+class SkylinePacker final : public AtlasPacker
+{
+public:
+    SkylinePacker(uint32_t count, const sConfig& config);
+    ~SkylinePacker();
+
+    bool compare(const cImage* a, const cImage* b) const override;
+
+    void setSize(const sSize& size) override;
+    bool add(const cImage* image, Turn turn) override;
+
+    uint32_t getRectsCount() const override;
+    const cImage* getImageByIndex(uint32_t idx) const override;
+    const sRect& getRectByIndex(uint32_t idx) const override;
+    bool isRotatedByIndex(uint32_t idx) const override;
+
+private:
+    bool findPosition(uint32_t width, uint32_t height, bool canRotate, uint32_t& nodeIdx, sRect& result) const;
+    bool fitsAt(uint32_t nodeIdx, uint32_t width, uint32_t height, uint32_t& y) const;
+    void addWaste(uint32_t nodeIdx, const sRect& rc);
+    void addLevel(uint32_t nodeIdx, const sRect& rc);
+
+private:
+    sRect m_area;
+
+    // horizontal segments of the top edge of used space, sorted by x
+    struct sNode
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+    };
+    std::vector<sNode> m_skyline;
+
+    // areas closed under the skyline
+    cMaxRectsBin m_waste;
+
+    struct sPiece
+    {
+        const cImage* image;
+        sRect rc;
+        bool rotated;
+    };
+    std::vector<sPiece> m_images;
+};
@@ -10,15 +10,59 @@
 
 #include <cstdint>
 
+enum class Method : uint32_t
+{
+    KDTree,
+    Simple,
+    MaxRects,
+    Skyline,
+    Best, // portfolio of methods, smallest atlas wins
+};
+
+// free rectangle choice for MaxRects
+enum class Heuristic : uint32_t
+{
+    BestShortSideFit,
+    BestLongSideFit,
+    BestAreaFit,
+    ContactPoint,
+};
+
+// speed and size tradeoff of PNG atlas
+enum class PngPreset : uint32_t
+{
+    Fast, // one filter for all rows, greedy deflate
+    Default,
+    Max, // best of filter strategies, optimal parse deflate
+};
+
 struct sConfig
 {
     uint32_t border = 0;
     uint32_t padding = 1;
     bool pot = false;
+    bool rotate = false;
     bool trim = false;
+    uint32_t alphaThreshold = 0u;
     bool overlay = false;
+    uint32_t overlayColor = 0x00ff00u; // RRGGBB
+    uint32_t overlayAlpha = 153u; // 0..255
     bool alowDupes = false;
-    bool slowMethod = false;
+    bool dedup = false;
+    Method method = Method::KDTree;
+    Heuristic heuristic = Heuristic::BestShortSideFit;
     bool dropExt = false;
+    bool lazyDecode = false;
     uint32_t maxTextureSize = 2048u;
+    bool multipage = false;
+    bool plan = false; // layout and description only, atlas is never composed
+    uint32_t threads = 0u; // 0 - use all available cores
+    bool speculative = false;
+    uint32_t timeBudget = 10000u; // ms, for best method
+    uint32_t optimizeTime = 0u; // ms, 0 - no deadline
+    uint32_t optimizeIterations = 0u; // per chain, 0 - no limit
+    uint32_t targetFill = 0u; // percent, optimizer stops on reaching it
+    uint64_t seed = 0u; // 0 - taken from current time
+    PngPreset pngPreset = PngPreset::Default;
+    uint32_t pngBudget = 10000u; // ms, max preset: first half for filter search, rest for optimal parse
 };
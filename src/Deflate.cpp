@@ -0,0 +1,1002 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "Deflate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace
+{
+
+    const uint32_t MinMatch = 3u;
+    const uint32_t MaxMatch = 258u;
+    const uint32_t HashBits = 15u;
+    const uint32_t HashSize = 1u << HashBits;
+    const size_t WindowMask = cDeflate::WindowSize - 1u;
+
+    const size_t BlockTokens = 32768u;
+    const uint32_t OptimalPasses = 16u; // limit, passes usually converge much earlier
+    const double OptimalGain = 0.001; // passes stop once parse gets cheaper by less than this part
+
+    struct sParams
+    {
+        uint32_t maxChain; // candidates checked per position
+        uint32_t lazyLength; // shorter matches are checked against the next position
+        uint32_t goodLength; // rest of search is cut by 4 after a match this long
+        uint32_t niceLength; // search stops at a match this long
+        uint32_t hashBytes; // 4 keeps chains free of short matches, optimal parse needs 3
+        bool insertMatched; // bytes inside matches go to hash chains
+    };
+
+    const sParams Params[] = {
+        { 2u, 0u, MaxMatch, 64u, 4u, false }, // Fast
+        { 32u, 32u, MaxMatch, 128u, 4u, true }, // Default
+        { 256u, 0u, 32u, 128u, 3u, true }, // Best, lazy matching isn't used by optimal parse
+    };
+
+    const uint32_t LitCodes = 286u;
+    const uint32_t DistCodes = 30u;
+    const uint32_t LengthCodes = 19u;
+
+    const uint16_t LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const uint8_t CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    uint32_t GetLengthCode(uint32_t length)
+    {
+        const uint32_t l = length - MinMatch;
+        if (l < 8u)
+        {
+            return l;
+        }
+        else if (l == 255u)
+        {
+            return 28u;
+        }
+
+        const uint32_t bits = 31u - static_cast<uint32_t>(__builtin_clz(l));
+        return (bits - 1u) * 4u + ((l >> (bits - 2u)) & 3u);
+    }
+
+    uint32_t GetDistCode(uint32_t dist)
+    {
+        const uint32_t d = dist - 1u;
+        if (d < 4u)
+        {
+            return d;
+        }
+
+        const uint32_t bits = 31u - static_cast<uint32_t>(__builtin_clz(d));
+        return bits * 2u + ((d >> (bits - 1u)) & 1u);
+    }
+
+    uint32_t Reverse(uint32_t code, uint32_t bits)
+    {
+        uint32_t result = 0u;
+        for (uint32_t i = 0; i < bits; i++)
+        {
+            result = (result << 1) | (code & 1u);
+            code >>= 1;
+        }
+        return result;
+    }
+
+    // Deflate bits go from the least significant one.
+    class cBitWriter final
+    {
+    public:
+        explicit cBitWriter(std::vector<uint8_t>& out)
+            : m_out(out)
+        {
+        }
+
+        void put(uint32_t value, uint32_t count)
+        {
+            m_bits |= uint64_t(value) << m_count;
+            m_count += count;
+            while (m_count >= 8u)
+            {
+                m_out.push_back(static_cast<uint8_t>(m_bits));
+                m_bits >>= 8;
+                m_count -= 8u;
+            }
+        }
+
+        void align()
+        {
+            if (m_count != 0u)
+            {
+                put(0u, 8u - m_count);
+            }
+        }
+
+        void putBytes(const uint8_t* data, size_t size)
+        {
+            m_out.insert(m_out.end(), data, data + size);
+        }
+
+        uint32_t getPending() const
+        {
+            return m_count;
+        }
+
+    private:
+        std::vector<uint8_t>& m_out;
+        uint64_t m_bits = 0u;
+        uint32_t m_count = 0u;
+    };
+
+    // Huffman code lengths limited to maxBits, most frequent symbols get shortest codes.
+    void BuildLengths(const uint32_t* freq, uint32_t count, uint32_t maxBits, uint8_t* lengths)
+    {
+        std::fill_n(lengths, count, 0u);
+
+        std::vector<uint32_t> symbols;
+        for (uint32_t s = 0; s < count; s++)
+        {
+            if (freq[s] != 0u)
+            {
+                symbols.push_back(s);
+            }
+        }
+
+        if (symbols.empty())
+        {
+            return;
+        }
+        else if (symbols.size() == 1u)
+        {
+            lengths[symbols[0]] = 1u;
+            return;
+        }
+
+        // tree of two least frequent nodes at a time, parents always go after children
+        struct sNode
+        {
+            uint64_t freq;
+            uint32_t parent;
+        };
+        std::vector<sNode> nodes;
+        using Item = std::pair<uint64_t, uint32_t>;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+        for (auto s : symbols)
+        {
+            queue.push({ freq[s], static_cast<uint32_t>(nodes.size()) });
+            nodes.push_back({ freq[s], 0u });
+        }
+
+        while (queue.size() > 1u)
+        {
+            const auto a = queue.top();
+            queue.pop();
+            const auto b = queue.top();
+            queue.pop();
+
+            const auto idx = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({ a.first + b.first, 0u });
+            nodes[a.second].parent = idx;
+            nodes[b.second].parent = idx;
+            queue.push({ a.first + b.first, idx });
+        }
+
+        std::vector<uint32_t> depth(nodes.size(), 0u);
+        for (size_t i = nodes.size() - 1u; i-- > 0;)
+        {
+            depth[i] = depth[nodes[i].parent] + 1u;
+        }
+
+        // codes over the limit are cut, then shorter codes are split to keep the tree complete
+        std::vector<uint32_t> counts(maxBits + 1u, 0u);
+        for (size_t i = 0; i < symbols.size(); i++)
+        {
+            counts[std::min(depth[i], maxBits)]++;
+        }
+
+        uint32_t total = 0u;
+        for (uint32_t i = 1; i <= maxBits; i++)
+        {
+            total += counts[i] << (maxBits - i);
+        }
+        while (total != (1u << maxBits))
+        {
+            counts[maxBits]--;
+            for (uint32_t i = maxBits - 1u; i > 0u; i--)
+            {
+                if (counts[i] != 0u)
+                {
+                    counts[i]--;
+                    counts[i + 1u] += 2u;
+                    break;
+                }
+            }
+            total--;
+        }
+
+        std::stable_sort(symbols.begin(), symbols.end(), [freq](uint32_t a, uint32_t b) -> bool {
+            return freq[a] > freq[b];
+        });
+
+        size_t idx = 0u;
+        for (uint32_t bits = 1; bits <= maxBits; bits++)
+        {
+            for (uint32_t i = 0; i < counts[bits]; i++)
+            {
+                lengths[symbols[idx++]] = static_cast<uint8_t>(bits);
+            }
+        }
+    }
+
+    // canonical codes, bit reversed for writing
+    void BuildCodes(const uint8_t* lengths, uint32_t count, uint16_t* codes)
+    {
+        uint32_t lengthCount[16] = {};
+        for (uint32_t s = 0; s < count; s++)
+        {
+            lengthCount[lengths[s]]++;
+        }
+        lengthCount[0] = 0u;
+
+        uint32_t next[16] = {};
+        uint32_t code = 0u;
+        for (uint32_t bits = 1; bits < 16u; bits++)
+        {
+            code = (code + lengthCount[bits - 1u]) << 1;
+            next[bits] = code;
+        }
+
+        for (uint32_t s = 0; s < count; s++)
+        {
+            const auto bits = lengths[s];
+            codes[s] = bits != 0u
+                ? static_cast<uint16_t>(Reverse(next[bits]++, bits))
+                : 0u;
+        }
+    }
+
+    struct sToken
+    {
+        uint16_t value; // literal byte or match length
+        uint16_t dist; // 0 for literal
+    };
+
+    struct sCodes
+    {
+        uint8_t litLengths[288];
+        uint8_t distLengths[32];
+    };
+
+    const sCodes& GetFixedCodes()
+    {
+        static const sCodes Codes = [] {
+            sCodes codes;
+            for (uint32_t s = 0; s < 288u; s++)
+            {
+                codes.litLengths[s] = s < 144u ? 8u : (s < 256u ? 9u : (s < 280u ? 7u : 8u));
+            }
+            std::fill_n(codes.distLengths, 32u, 5u);
+            return codes;
+        }();
+
+        return Codes;
+    }
+
+    uint64_t GetDataBits(const uint32_t* litFreq, const uint32_t* distFreq, const sCodes& codes)
+    {
+        uint64_t bits = 0u;
+        for (uint32_t s = 0; s < LitCodes; s++)
+        {
+            const uint32_t extra = s > 256u ? LengthExtra[s - 257u] : 0u;
+            bits += uint64_t(litFreq[s]) * (codes.litLengths[s] + extra);
+        }
+        for (uint32_t s = 0; s < DistCodes; s++)
+        {
+            bits += uint64_t(distFreq[s]) * (codes.distLengths[s] + DistExtra[s]);
+        }
+        return bits;
+    }
+
+    struct sLengthSymbol
+    {
+        uint8_t symbol;
+        uint8_t extra;
+    };
+
+    // code lengths with runs packed by symbols 16 (repeat), 17 and 18 (zeros)
+    void PackLengths(const uint8_t* lengths, uint32_t count, std::vector<sLengthSymbol>& out)
+    {
+        uint32_t i = 0;
+        while (i < count)
+        {
+            const auto value = lengths[i];
+            uint32_t run = 1u;
+            while (i + run < count && lengths[i + run] == value)
+            {
+                run++;
+            }
+            i += run;
+
+            if (value == 0u)
+            {
+                while (run >= 11u)
+                {
+                    const auto n = std::min(run, 138u);
+                    out.push_back({ 18u, static_cast<uint8_t>(n - 11u) });
+                    run -= n;
+                }
+                if (run >= 3u)
+                {
+                    out.push_back({ 17u, static_cast<uint8_t>(run - 3u) });
+                    run = 0u;
+                }
+            }
+            else
+            {
+                out.push_back({ value, 0u });
+                run--;
+                while (run >= 3u)
+                {
+                    const auto n = std::min(run, 6u);
+                    out.push_back({ 16u, static_cast<uint8_t>(n - 3u) });
+                    run -= n;
+                }
+            }
+
+            for (; run > 0u; run--)
+            {
+                out.push_back({ value, 0u });
+            }
+        }
+    }
+
+    void WriteStored(cBitWriter& writer, const uint8_t* data, size_t size, bool isFinal)
+    {
+        size_t offset = 0u;
+        do
+        {
+            const auto n = static_cast<uint32_t>(std::min<size_t>(size - offset, 65535u));
+            const bool isLast = offset + n == size;
+            writer.put(isFinal && isLast ? 1u : 0u, 1u);
+            writer.put(0u, 2u);
+            writer.align();
+            writer.put(n, 16u);
+            writer.put(~n & 0xffffu, 16u);
+            writer.putBytes(data + offset, n);
+            offset += n;
+        } while (offset < size);
+    }
+
+    void WriteTokens(cBitWriter& writer, const std::vector<sToken>& tokens, const sCodes& codes)
+    {
+        uint16_t litCodes[288];
+        uint16_t distCodes[32];
+        BuildCodes(codes.litLengths, 288u, litCodes);
+        BuildCodes(codes.distLengths, 32u, distCodes);
+
+        for (const auto& t : tokens)
+        {
+            if (t.dist == 0u)
+            {
+                writer.put(litCodes[t.value], codes.litLengths[t.value]);
+            }
+            else
+            {
+                const auto lc = GetLengthCode(t.value);
+                writer.put(litCodes[257u + lc], codes.litLengths[257u + lc]);
+                writer.put(t.value - LengthBase[lc], LengthExtra[lc]);
+
+                const auto dc = GetDistCode(t.dist);
+                writer.put(distCodes[dc], codes.distLengths[dc]);
+                writer.put(t.dist - DistBase[dc], DistExtra[dc]);
+            }
+        }
+        writer.put(litCodes[256], codes.litLengths[256]);
+    }
+
+    // Dynamic, fixed or stored block, whichever is shorter.
+    void WriteBlock(cBitWriter& writer, const std::vector<sToken>& tokens, const uint8_t* raw, size_t rawSize, bool isFinal)
+    {
+        const auto& fixed = GetFixedCodes();
+        if (tokens.empty())
+        {
+            writer.put(isFinal ? 1u : 0u, 1u);
+            writer.put(1u, 2u);
+            WriteTokens(writer, tokens, fixed);
+            return;
+        }
+
+        uint32_t litFreq[LitCodes] = {};
+        uint32_t distFreq[DistCodes] = {};
+        for (const auto& t : tokens)
+        {
+            if (t.dist == 0u)
+            {
+                litFreq[t.value]++;
+            }
+            else
+            {
+                litFreq[257u + GetLengthCode(t.value)]++;
+                distFreq[GetDistCode(t.dist)]++;
+            }
+        }
+        litFreq[256] = 1u;
+
+        sCodes dynamic = {};
+        BuildLengths(litFreq, LitCodes, 15u, dynamic.litLengths);
+
+        // at least one distance code is sent even if no match is used
+        uint32_t distUsed[DistCodes];
+        std::copy_n(distFreq, DistCodes, distUsed);
+        if (std::all_of(distUsed, distUsed + DistCodes, [](uint32_t f) { return f == 0u; }))
+        {
+            distUsed[0] = 1u;
+        }
+        BuildLengths(distUsed, DistCodes, 15u, dynamic.distLengths);
+
+        uint32_t hlit = LitCodes;
+        while (hlit > 257u && dynamic.litLengths[hlit - 1u] == 0u)
+        {
+            hlit--;
+        }
+        uint32_t hdist = DistCodes;
+        while (hdist > 1u && dynamic.distLengths[hdist - 1u] == 0u)
+        {
+            hdist--;
+        }
+
+        uint8_t lengths[LitCodes + DistCodes];
+        std::copy_n(dynamic.litLengths, hlit, lengths);
+        std::copy_n(dynamic.distLengths, hdist, lengths + hlit);
+
+        std::vector<sLengthSymbol> packed;
+        PackLengths(lengths, hlit + hdist, packed);
+
+        uint32_t lengthFreq[LengthCodes] = {};
+        for (const auto& p : packed)
+        {
+            lengthFreq[p.symbol]++;
+        }
+        uint8_t lengthLengths[LengthCodes];
+        BuildLengths(lengthFreq, LengthCodes, 7u, lengthLengths);
+
+        uint32_t hclen = LengthCodes;
+        while (hclen > 4u && lengthLengths[CodeLengthOrder[hclen - 1u]] == 0u)
+        {
+            hclen--;
+        }
+
+        static const uint8_t LengthSymbolExtra[3] = { 2u, 3u, 7u };
+        uint64_t dynamicBits = 3u + 14u + hclen * 3u + GetDataBits(litFreq, distFreq, dynamic);
+        for (const auto& p : packed)
+        {
+            dynamicBits += lengthLengths[p.symbol] + (p.symbol >= 16u ? LengthSymbolExtra[p.symbol - 16u] : 0u);
+        }
+        const uint64_t fixedBits = 3u + GetDataBits(litFreq, distFreq, fixed);
+        const uint64_t storedBits = ((writer.getPending() + 3u + 7u) & ~7u) - writer.getPending()
+            + (rawSize / 65535u + 1u) * 40u + rawSize * 8u;
+
+        if (storedBits < dynamicBits && storedBits < fixedBits)
+        {
+            WriteStored(writer, raw, rawSize, isFinal);
+        }
+        else if (fixedBits <= dynamicBits)
+        {
+            writer.put(isFinal ? 1u : 0u, 1u);
+            writer.put(1u, 2u);
+            WriteTokens(writer, tokens, fixed);
+        }
+        else
+        {
+            writer.put(isFinal ? 1u : 0u, 1u);
+            writer.put(2u, 2u);
+            writer.put(hlit - 257u, 5u);
+            writer.put(hdist - 1u, 5u);
+            writer.put(hclen - 4u, 4u);
+            for (uint32_t i = 0; i < hclen; i++)
+            {
+                writer.put(lengthLengths[CodeLengthOrder[i]], 3u);
+            }
+
+            uint16_t lengthCodes[LengthCodes];
+            BuildCodes(lengthLengths, LengthCodes, lengthCodes);
+            for (const auto& p : packed)
+            {
+                writer.put(lengthCodes[p.symbol], lengthLengths[p.symbol]);
+                if (p.symbol >= 16u)
+                {
+                    writer.put(p.extra, LengthSymbolExtra[p.symbol - 16u]);
+                }
+            }
+
+            WriteTokens(writer, tokens, dynamic);
+        }
+    }
+
+    uint32_t GetMatchLength(const uint8_t* a, const uint8_t* b, uint32_t maxLength)
+    {
+        uint32_t length = 0u;
+        while (length + 8u <= maxLength)
+        {
+            uint64_t x;
+            uint64_t y;
+            ::memcpy(&x, a + length, 8u);
+            ::memcpy(&y, b + length, 8u);
+            if (x != y)
+            {
+                // first differing byte, little endian
+                return length + static_cast<uint32_t>(__builtin_ctzll(x ^ y)) / 8u;
+            }
+            length += 8u;
+        }
+
+        while (length < maxLength && a[length] == b[length])
+        {
+            length++;
+        }
+        return length;
+    }
+
+    // Hash chains over the piece and its dictionary, positions count from
+    // the start of dictionary.
+    class cMatcher final
+    {
+    public:
+        cMatcher(const uint8_t* base, size_t end, const sParams& params)
+            : m_base(base)
+            , m_end(end)
+            , m_params(params)
+            , m_head(HashSize, -1)
+            , m_prev(cDeflate::WindowSize, -1)
+        {
+        }
+
+        const uint8_t* getBase() const
+        {
+            return m_base;
+        }
+
+        void insert(size_t pos)
+        {
+            if (pos + m_params.hashBytes <= m_end)
+            {
+                const auto h = hash(pos);
+                m_prev[pos & WindowMask] = m_head[h];
+                m_head[h] = static_cast<int32_t>(pos);
+            }
+        }
+
+        // Longest match, 0 if there is none.
+        uint32_t find(size_t pos, uint32_t& dist) const
+        {
+            uint32_t best = 0u;
+            search(pos, [&](uint32_t length, uint32_t d) {
+                best = length;
+                dist = d;
+            });
+            return best;
+        }
+
+        // Every match longer than previous one found, nearest first, so each
+        // length is reached with the shortest distance.
+        void findAll(size_t pos, std::vector<sToken>& matches) const
+        {
+            search(pos, [&](uint32_t length, uint32_t dist) {
+                matches.push_back({ static_cast<uint16_t>(length), static_cast<uint16_t>(dist) });
+            });
+        }
+
+    private:
+        uint32_t hash(size_t pos) const
+        {
+            uint32_t v = m_base[pos] | (m_base[pos + 1u] << 8) | (m_base[pos + 2u] << 16);
+            if (m_params.hashBytes == 4u)
+            {
+                v |= uint32_t(m_base[pos + 3u]) << 24;
+            }
+            return (v * 2654435761u) >> (32u - HashBits);
+        }
+
+        template <typename Callback>
+        void search(size_t pos, const Callback& callback) const
+        {
+            const auto maxLength = static_cast<uint32_t>(std::min<size_t>(MaxMatch, m_end - pos));
+            if (maxLength < m_params.hashBytes)
+            {
+                return;
+            }
+
+            const size_t limit = pos > cDeflate::WindowSize ? pos - cDeflate::WindowSize : 0u;
+            const uint8_t* current = m_base + pos;
+
+            uint32_t best = MinMatch - 1u;
+            uint32_t chain = m_params.maxChain;
+            for (auto candidate = m_head[hash(pos)]; candidate >= 0 && size_t(candidate) >= limit && chain-- > 0u;
+                 candidate = m_prev[candidate & WindowMask])
+            {
+                const uint8_t* match = m_base + candidate;
+                if (match[best] != current[best] || match[0] != current[0])
+                {
+                    continue;
+                }
+
+                const auto length = GetMatchLength(match, current, maxLength);
+                if (length > best)
+                {
+                    best = length;
+                    callback(length, static_cast<uint32_t>(pos - candidate));
+                    if (length >= m_params.niceLength || length == maxLength)
+                    {
+                        break;
+                    }
+                    else if (length >= m_params.goodLength)
+                    {
+                        chain >>= 2;
+                    }
+                }
+            }
+        }
+
+    private:
+        const uint8_t* m_base;
+        const size_t m_end;
+        const sParams& m_params;
+
+        std::vector<int32_t> m_head;
+        std::vector<int32_t> m_prev;
+    };
+
+    // Greedy parse, with one step lazy matching if enabled.
+    void ParseLazy(cMatcher& matcher, const sParams& params, size_t begin, size_t end, std::vector<sToken>& tokens)
+    {
+        auto base = matcher.getBase();
+
+        size_t pos = begin;
+        while (pos < end)
+        {
+            uint32_t dist = 0u;
+            auto length = matcher.find(pos, dist);
+            matcher.insert(pos);
+
+            // a longer match at the next byte wins
+            if (length != 0u && length < params.lazyLength && pos + 1u < end)
+            {
+                uint32_t nextDist = 0u;
+                const auto nextLength = matcher.find(pos + 1u, nextDist);
+                if (nextLength > length)
+                {
+                    tokens.push_back({ base[pos], 0u });
+                    pos++;
+                    matcher.insert(pos);
+                    length = nextLength;
+                    dist = nextDist;
+                }
+            }
+
+            if (length == 0u)
+            {
+                tokens.push_back({ base[pos], 0u });
+                pos++;
+            }
+            else
+            {
+                tokens.push_back({ static_cast<uint16_t>(length), static_cast<uint16_t>(dist) });
+                if (params.insertMatched)
+                {
+                    for (uint32_t i = 1; i < length; i++)
+                    {
+                        matcher.insert(pos + i);
+                    }
+                }
+                pos += length;
+            }
+        }
+    }
+
+    // Price of symbols in bits.
+    struct sCostModel
+    {
+        double lit[256];
+        double length[MaxMatch + 1u];
+        double dist[DistCodes];
+
+        // entropy of symbols of previous parse
+        void set(const std::vector<sToken>& tokens)
+        {
+            uint32_t litFreq[LitCodes] = {};
+            uint32_t distFreq[DistCodes] = {};
+            for (const auto& t : tokens)
+            {
+                if (t.dist == 0u)
+                {
+                    litFreq[t.value]++;
+                }
+                else
+                {
+                    litFreq[257u + GetLengthCode(t.value)]++;
+                    distFreq[GetDistCode(t.dist)]++;
+                }
+            }
+            litFreq[256] = 1u;
+
+            double litBits[LitCodes];
+            double distBits[DistCodes];
+            GetEntropy(litFreq, LitCodes, litBits);
+            GetEntropy(distFreq, DistCodes, distBits);
+            std::copy_n(litBits, 256u, lit);
+            setMatches(litBits, distBits);
+        }
+
+    private:
+        template <typename T>
+        void setMatches(const T* litBits, const T* distBits)
+        {
+            for (uint32_t l = MinMatch; l <= MaxMatch; l++)
+            {
+                const auto code = GetLengthCode(l);
+                length[l] = litBits[257u + code] + LengthExtra[code];
+            }
+            for (uint32_t code = 0; code < DistCodes; code++)
+            {
+                dist[code] = distBits[code] + DistExtra[code];
+            }
+        }
+
+        static void GetEntropy(const uint32_t* freq, uint32_t count, double* bits)
+        {
+            uint64_t total = 0u;
+            for (uint32_t s = 0; s < count; s++)
+            {
+                total += freq[s];
+            }
+
+            // unused symbols are priced as if they were seen half a time
+            const double log = std::log2(double(std::max<uint64_t>(total, 1u)));
+            for (uint32_t s = 0; s < count; s++)
+            {
+                bits[s] = log - std::log2(freq[s] != 0u ? double(freq[s]) : 0.5);
+            }
+        }
+    };
+
+    // Size of parse in bits, if coded by its own statistics.
+    double GetBits(const sCostModel& model, const std::vector<sToken>& tokens)
+    {
+        double bits = 0.0;
+        for (const auto& t : tokens)
+        {
+            bits += t.dist == 0u
+                ? model.lit[t.value]
+                : model.length[t.value] + model.dist[GetDistCode(t.dist)];
+        }
+        return bits;
+    }
+
+    // Shortest path over positions, edges are literals and matches of
+    // every length, priced by the model. Tokens come in as the seed parse,
+    // every pass is priced by the statistics of the previous one, the
+    // cheapest parse is kept.
+    void ParseOptimal(cMatcher& matcher, const sParams& params, size_t begin, size_t end, std::vector<sToken>& tokens)
+    {
+        auto base = matcher.getBase();
+        const size_t count = end - begin;
+
+        // positions covered by a match of nice length get literal edges only,
+        // searching every one of them would be slow on long runs
+        std::vector<uint32_t> offsets(count + 1u);
+        std::vector<sToken> matches;
+        size_t skipTo = begin;
+        for (size_t pos = begin; pos < end; pos++)
+        {
+            offsets[pos - begin] = static_cast<uint32_t>(matches.size());
+            if (pos >= skipTo)
+            {
+                matcher.findAll(pos, matches);
+                if (matches.size() != offsets[pos - begin] && matches.back().value >= params.niceLength)
+                {
+                    skipTo = pos + matches.back().value;
+                }
+            }
+            matcher.insert(pos);
+        }
+        offsets[count] = static_cast<uint32_t>(matches.size());
+
+        sCostModel model;
+        model.set(tokens);
+        auto bestBits = GetBits(model, tokens);
+
+        std::vector<double> costs(count + 1u);
+        std::vector<sToken> steps(count + 1u);
+        std::vector<sToken> parse;
+        for (uint32_t pass = 0; pass < OptimalPasses; pass++)
+        {
+            std::fill(costs.begin(), costs.end(), std::numeric_limits<double>::max());
+            costs[0] = 0.0;
+            for (size_t i = 0; i < count; i++)
+            {
+                const auto cost = costs[i];
+
+                const auto literal = base[begin + i];
+                if (cost + model.lit[literal] < costs[i + 1u])
+                {
+                    costs[i + 1u] = cost + model.lit[literal];
+                    steps[i + 1u] = { literal, 0u };
+                }
+
+                uint32_t length = MinMatch;
+                for (uint32_t m = offsets[i]; m < offsets[i + 1u]; m++)
+                {
+                    const auto& match = matches[m];
+                    const auto distCost = cost + model.dist[GetDistCode(match.dist)];
+                    for (; length <= match.value; length++)
+                    {
+                        const auto next = distCost + model.length[length];
+                        if (next < costs[i + length])
+                        {
+                            costs[i + length] = next;
+                            steps[i + length] = { static_cast<uint16_t>(length), match.dist };
+                        }
+                    }
+                }
+            }
+
+            parse.clear();
+            for (size_t i = count; i > 0u;)
+            {
+                const auto& step = steps[i];
+                parse.push_back(step);
+                i -= step.dist == 0u ? 1u : step.value;
+            }
+            std::reverse(parse.begin(), parse.end());
+
+            model.set(parse);
+            const auto bits = GetBits(model, parse);
+            if (bits >= bestBits)
+            {
+                break;
+            }
+
+            const bool isConverged = bestBits - bits < bestBits * OptimalGain;
+            bestBits = bits;
+            tokens.swap(parse);
+            if (isConverged)
+            {
+                break;
+            }
+        }
+    }
+
+    // Deflate stream of a piece, tokens go by blocks. Raw bytes are the ones
+    // covered by tokens, for blocks that are cheaper stored.
+    void WriteStream(const std::vector<sToken>& tokens, const uint8_t* raw, bool isFinal, std::vector<uint8_t>& out)
+    {
+        cBitWriter writer(out);
+        std::vector<sToken> block;
+        size_t blockStart = 0u;
+        for (size_t first = 0u; first < tokens.size();)
+        {
+            const size_t last = std::min(tokens.size(), first + BlockTokens);
+            block.assign(tokens.begin() + first, tokens.begin() + last);
+
+            size_t blockSize = 0u;
+            for (const auto& t : block)
+            {
+                blockSize += t.dist == 0u ? 1u : t.value;
+            }
+
+            WriteBlock(writer, block, raw + blockStart, blockSize, isFinal && last == tokens.size());
+            blockStart += blockSize;
+            first = last;
+        }
+
+        if (isFinal)
+        {
+            if (tokens.empty())
+            {
+                WriteBlock(writer, tokens, raw + blockStart, 0u, true);
+            }
+            writer.align();
+        }
+        else
+        {
+            // empty stored block brings the piece to a byte boundary
+            WriteStored(writer, nullptr, 0u, false);
+        }
+    }
+
+} // namespace
+
+void cDeflate::Compress(const uint8_t* data, size_t size, size_t dictSize, bool isFinal, Level level, std::vector<uint8_t>& out)
+{
+    dictSize = std::min(dictSize, WindowSize);
+
+    const uint8_t* base = data - dictSize;
+    const size_t end = dictSize + size;
+
+    const auto& params = Params[static_cast<uint32_t>(level)];
+    cMatcher matcher(base, end, params);
+    for (size_t pos = 0; pos < dictSize; pos++)
+    {
+        matcher.insert(pos);
+    }
+
+    std::vector<sToken> tokens;
+    if (level == Level::Best)
+    {
+        // prices of the first optimal pass come from lazy parse over the same
+        // hash chains, so short matches are priced as well
+        auto seedParams = Params[static_cast<uint32_t>(Level::Default)];
+        seedParams.hashBytes = params.hashBytes;
+        cMatcher seedMatcher(base, end, seedParams);
+        for (size_t pos = 0; pos < dictSize; pos++)
+        {
+            seedMatcher.insert(pos);
+        }
+        ParseLazy(seedMatcher, seedParams, dictSize, end, tokens);
+
+        std::vector<uint8_t> seed;
+        WriteStream(tokens, base + dictSize, isFinal, seed);
+
+        // estimated bits may mislead, the seed stays if it is smaller
+        std::vector<uint8_t> optimal;
+        ParseOptimal(matcher, params, dictSize, end, tokens);
+        WriteStream(tokens, base + dictSize, isFinal, optimal);
+
+        const auto& best = optimal.size() < seed.size() ? optimal : seed;
+        out.insert(out.end(), best.begin(), best.end());
+        return;
+    }
+
+    ParseLazy(matcher, params, dictSize, end, tokens);
+    WriteStream(tokens, base + dictSize, isFinal, out);
+}
+
+uint32_t cDeflate::Adler32(const uint8_t* data, size_t size, uint32_t adler)
+{
+    const uint32_t Base = 65521u;
+    const size_t MaxRun = 5552u; // longest run without overflow of 32 bit sums
+
+    uint32_t a = adler & 0xffffu;
+    uint32_t b = adler >> 16;
+    while (size > 0u)
+    {
+        auto n = std::min(size, MaxRun);
+        size -= n;
+        for (; n > 0u; n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= Base;
+        b %= Base;
+    }
+
+    return (b << 16) | a;
+}
+
+uint32_t cDeflate::Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    const uint64_t Base = 65521u;
+    const uint64_t rem = size2 % Base;
+
+    uint64_t sum1 = adler1 & 0xffffu;
+    uint64_t sum2 = (rem * sum1) % Base;
+    sum1 += (adler2 & 0xffffu) + Base - 1u;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + Base - rem;
+
+    return static_cast<uint32_t>(((sum2 % Base) << 16) | (sum1 % Base));
+}
@@ -0,0 +1,39 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Raw deflate (RFC 1951) encoder for independent pieces of one stream.
+// A piece may refer back to up to 32 KiB of data preceding it, pieces
+// compressed separately are joined just by appending their output.
+class cDeflate final
+{
+public:
+    // Data before the piece, matches may point into it.
+    static constexpr size_t WindowSize = 32768u;
+
+    enum class Level : uint32_t
+    {
+        Fast, // greedy parse over short hash chains
+        Default, // lazy matching
+        Best, // optimal parse, several times slower
+    };
+
+    // Non-final piece ends with an empty stored block, so it stops at a byte
+    // boundary and next piece can be appended to it.
+    static void Compress(const uint8_t* data, size_t size, size_t dictSize, bool isFinal, Level level, std::vector<uint8_t>& out);
+
+    static uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1u);
+
+    // Adler-32 of two pieces joined, size is of the second one.
+    static uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2);
+};
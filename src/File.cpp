@@ -9,6 +9,10 @@
 #include "File.h"
 
 #include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 cFile::cFile()
     : m_file(nullptr)
@@ -82,3 +86,54 @@ long cFile::getOffset() const
 
     return 0;
 }
+
+cMappedFile::~cMappedFile()
+{
+    close();
+}
+
+bool cMappedFile::open(const char* path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+#if defined(POSIX_FADV_SEQUENTIAL)
+        (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+        const auto size = static_cast<size_t>(st.st_size);
+        auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            (void)::madvise(data, size, MADV_SEQUENTIAL);
+            (void)::madvise(data, size, MADV_WILLNEED);
+
+            m_data = static_cast<uint8_t*>(data);
+            m_size = size;
+        }
+    }
+
+    // mapping stays valid after the descriptor is closed
+    ::close(fd);
+
+    return m_data != nullptr;
+}
+
+void cMappedFile::close()
+{
+    if (m_data != nullptr)
+    {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 class cFile final
@@ -31,3 +32,24 @@ protected:
     void* m_file;
     long m_size;
 };
+
+class cMappedFile final
+{
+public:
+    cMappedFile() = default;
+    ~cMappedFile();
+
+    cMappedFile(const cMappedFile&) = delete;
+    cMappedFile& operator=(const cMappedFile&) = delete;
+
+    // Maps the whole file read-only and asks kernel to read it ahead.
+    bool open(const char* path);
+    void close();
+
+    const uint8_t* getData() const { return m_data; }
+    size_t getSize() const { return m_size; }
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
@@ -7,12 +7,17 @@
 \**********************************************/
 
 #include "Image.h"
+#include "File.h"
+#include "SpriteCache.h"
 #include "Trim.h"
+#include "Types/Allocator.h"
+#include "Utils.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
 #include <algorithm>
+#include <climits>
 #include <cstring>
 
 namespace
@@ -44,6 +49,56 @@ namespace
         return res;
     }
 
+    stbi_uc* LoadPixels(const char* path, int& width, int& height, int& bpp)
+    {
+        cMappedFile file;
+        if (file.open(path) && file.getSize() <= static_cast<size_t>(INT_MAX))
+        {
+            return stbi_load_from_memory(file.getData(), static_cast<int>(file.getSize()), &width, &height, &bpp, 4);
+        }
+
+        // fallback to stdio if file can't be mapped
+        return stbi_load(path, &width, &height, &bpp, 4);
+    }
+
+    bool HasAlpha(int bpp)
+    {
+        return bpp == 2 || bpp == 4;
+    }
+
+    uint64_t HashBitmap(const cBitmap& bitmap)
+    {
+        auto& size = bitmap.getSize();
+        auto hash = getHash(&size, sizeof(size));
+
+        auto src = bitmap.getData();
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            hash = getHash(src, size.width * sizeof(cBitmap::Pixel), hash);
+            src += bitmap.getPitch();
+        }
+
+        return hash;
+    }
+
+    bool CopyRegion(const cBitmap::Pixel* src, uint32_t pitch, const sSize& size, cBitmap& bitmap, cAllocator& allocator)
+    {
+        if (bitmap.createBitmap(size, allocator) == false)
+        {
+            return false;
+        }
+
+        auto dst = bitmap.getData();
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            std::copy(src, src + size.width, dst);
+            src += pitch;
+            dst += bitmap.getPitch();
+        }
+
+        return true;
+    }
+
 } // namespace
 
 bool cImage::IsImage(const char* path)
@@ -60,6 +115,10 @@ bool cImage::IsImage(const char* path)
     return false;
 }
 
+cImage::cImage()
+{
+}
+
 cImage::~cImage()
 {
     clear();
@@ -74,12 +133,11 @@ void cImage::clear()
     }
 
     m_bitmap.clear();
+    m_cacheFile.reset();
 }
 
-bool cImage::load(const char* path, uint32_t trimPath, cTrim* trim)
+bool cImage::setName(const char* path, uint32_t trimPath)
 {
-    clear();
-
     m_name = path;
 
     m_spriteId = TrimPath(path, trimPath);
@@ -89,6 +147,41 @@ bool cImage::load(const char* path, uint32_t trimPath, cTrim* trim)
         return false;
     }
 
+    return true;
+}
+
+void cImage::setInfo(const sSpriteInfo& info)
+{
+    m_originalSize = info.originalSize;
+    m_offset = info.offset;
+    m_size = info.size;
+}
+
+bool cImage::load(const char* path, uint32_t trimPath, cTrim* trim, const cSpriteCache* cache)
+{
+    clear();
+
+    if (setName(path, trimPath) == false)
+    {
+        return false;
+    }
+
+    m_cache = cache;
+    if (cache != nullptr)
+    {
+        std::unique_ptr<cMappedFile> file(new cMappedFile());
+        sSpriteInfo info;
+        const cBitmap::Pixel* pixels;
+        if (cache->find(path, *file, info, pixels))
+        {
+            setInfo(info);
+            m_bitmap.setBitmap(m_size, const_cast<cBitmap::Pixel*>(pixels));
+            m_cacheFile = std::move(file);
+
+            return true;
+        }
+    }
+
     // N=#comp | components
     // --------+------------------------
     // 1       | grey
@@ -98,7 +191,7 @@ bool cImage::load(const char* path, uint32_t trimPath, cTrim* trim)
     int width;
     int height;
     int bpp;
-    m_stbImageData = stbi_load(path, &width, &height, &bpp, 4);
+    m_stbImageData = LoadPixels(path, width, height, bpp);
 
     m_originalSize = {
         static_cast<uint32_t>(width),
@@ -107,14 +200,218 @@ bool cImage::load(const char* path, uint32_t trimPath, cTrim* trim)
 
     m_bitmap.setBitmap(m_originalSize, m_stbImageData);
 
-    if (m_stbImageData != nullptr && trim != nullptr)
+    // nothing to trim if source has no alpha channel
+    if (m_stbImageData != nullptr && trim != nullptr && HasAlpha(bpp))
     {
+        // trimmed bitmap refers to decoded pixels, so only one copy is in memory
         if (trim->trim(path, m_bitmap))
         {
-            m_bitmap = std::move(trim->getBitmap());
             m_offset = trim->getOffset();
+            m_bitmap.setView(trim->getBitmap(), { 0u, 0u }, trim->getBitmap().getSize());
         }
     }
 
+    m_size = m_bitmap.getSize();
+
+    if (m_stbImageData != nullptr && cache != nullptr)
+    {
+        cache->store(path, { m_originalSize, m_offset, m_size }, m_bitmap.getData(), m_bitmap.getPitch());
+    }
+
     return m_stbImageData != nullptr;
 }
+
+bool cImage::probe(const char* path, uint32_t trimPath, cTrim* trim, const cSpriteCache* cache)
+{
+    clear();
+
+    if (setName(path, trimPath) == false)
+    {
+        return false;
+    }
+
+    m_cache = cache;
+    if (cache != nullptr)
+    {
+        cMappedFile file;
+        sSpriteInfo info;
+        const cBitmap::Pixel* pixels;
+        if (cache->find(path, file, info, pixels))
+        {
+            setInfo(info);
+            return true;
+        }
+    }
+
+    int width;
+    int height;
+    int bpp;
+
+    if (trim == nullptr)
+    {
+        if (stbi_info(path, &width, &height, &bpp) == 0)
+        {
+            return false;
+        }
+
+        m_originalSize = {
+            static_cast<uint32_t>(width),
+            static_cast<uint32_t>(height)
+        };
+        m_size = m_originalSize;
+
+        return true;
+    }
+
+    // alpha bounds need the pixels, but only the bounds are kept
+    auto data = LoadPixels(path, width, height, bpp);
+    if (data == nullptr)
+    {
+        return false;
+    }
+
+    m_originalSize = {
+        static_cast<uint32_t>(width),
+        static_cast<uint32_t>(height)
+    };
+    m_size = m_originalSize;
+
+    cBitmap bitmap;
+    bitmap.setBitmap(m_originalSize, data);
+    if (HasAlpha(bpp))
+    {
+        trim->getBounds(bitmap, m_offset, m_size);
+    }
+
+    if (cache != nullptr)
+    {
+        auto src = bitmap.getData() + m_offset.y * bitmap.getPitch() + m_offset.x;
+        cache->store(path, { m_originalSize, m_offset, m_size }, src, bitmap.getPitch());
+    }
+
+    stbi_image_free(data);
+
+    return true;
+}
+
+bool cImage::decode(cBitmap& bitmap, cAllocator& allocator) const
+{
+    if (m_cache != nullptr)
+    {
+        cMappedFile file;
+        sSpriteInfo info;
+        const cBitmap::Pixel* pixels;
+        if (m_cache->find(m_name.c_str(), file, info, pixels)
+            && info.size.width == m_size.width
+            && info.size.height == m_size.height)
+        {
+            return CopyRegion(pixels, m_size.width, m_size, bitmap, allocator);
+        }
+    }
+
+    int width;
+    int height;
+    int bpp;
+    auto data = LoadPixels(m_name.c_str(), width, height, bpp);
+    if (data == nullptr)
+    {
+        return false;
+    }
+
+    bool isDecoded = false;
+    const bool isSame = static_cast<uint32_t>(width) == m_originalSize.width
+        && static_cast<uint32_t>(height) == m_originalSize.height;
+    if (isSame)
+    {
+        auto src = reinterpret_cast<const cBitmap::Pixel*>(data) + m_offset.y * m_originalSize.width + m_offset.x;
+        isDecoded = CopyRegion(src, m_originalSize.width, m_size, bitmap, allocator);
+
+        if (m_cache != nullptr)
+        {
+            m_cache->store(m_name.c_str(), { m_originalSize, m_offset, m_size }, src, m_originalSize.width);
+        }
+    }
+    else
+    {
+        ::printf("(EE) Image '%s' has been changed since probing.\n", m_name.c_str());
+    }
+
+    stbi_image_free(data);
+
+    return isDecoded;
+}
+
+bool cImage::updateHash()
+{
+    if (m_bitmap.getData() != nullptr || m_size.width == 0 || m_size.height == 0)
+    {
+        m_hash = HashBitmap(m_bitmap);
+        return true;
+    }
+
+    cBitmap bitmap;
+    if (decode(bitmap, cAllocator::GetHeap()) == false)
+    {
+        return false;
+    }
+
+    m_hash = HashBitmap(bitmap);
+    return true;
+}
+
+bool cImage::isSame(const cImage& other) const
+{
+    if (other.m_bitmap.getData() != nullptr || other.m_size.width == 0 || other.m_size.height == 0)
+    {
+        return isSame(other, other.m_bitmap);
+    }
+
+    cBitmap decoded;
+    if (other.decode(decoded, cAllocator::GetHeap()) == false)
+    {
+        return false;
+    }
+
+    return isSame(other, decoded);
+}
+
+bool cImage::isSame(const cImage& other, const cBitmap& otherPixels) const
+{
+    if (m_hash != other.m_hash
+        || m_size.width != other.m_size.width
+        || m_size.height != other.m_size.height)
+    {
+        return false;
+    }
+
+    if (m_size.width == 0 || m_size.height == 0)
+    {
+        return true;
+    }
+
+    const auto& b = otherPixels;
+    if (b.getData() == nullptr || b.getSize().width != m_size.width || b.getSize().height != m_size.height)
+    {
+        return false;
+    }
+
+    // hash match isn't enough, pixels not in memory are decoded to compare
+    cBitmap decoded;
+    if (m_bitmap.getData() == nullptr && decode(decoded, cAllocator::GetHeap()) == false)
+    {
+        return false;
+    }
+
+    auto& a = m_bitmap.getData() != nullptr ? m_bitmap : decoded;
+
+    const auto rowSize = m_size.width * sizeof(cBitmap::Pixel);
+    for (uint32_t y = 0; y < m_size.height; y++)
+    {
+        if (::memcmp(a.getData() + y * a.getPitch(), b.getData() + y * b.getPitch(), rowSize) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
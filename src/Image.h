@@ -10,9 +10,15 @@
 
 #include "Types/Bitmap.h"
 
+#include <memory>
 #include <string>
+#include <vector>
 
+class cAllocator;
+class cMappedFile;
+class cSpriteCache;
 class cTrim;
+struct sSpriteInfo;
 
 class cImage final
 {
@@ -20,17 +26,54 @@ public:
     static bool IsImage(const char* path);
 
 public:
+    cImage();
     ~cImage();
 
     void clear();
 
-    bool load(const char* path, uint32_t trimPath, cTrim* trim);
+    bool load(const char* path, uint32_t trimPath, cTrim* trim, const cSpriteCache* cache);
+
+    // Reads sprite geometry only, pixels are decoded later by decode().
+    bool probe(const char* path, uint32_t trimPath, cTrim* trim, const cSpriteCache* cache);
+    bool decode(cBitmap& bitmap, cAllocator& allocator) const;
+
+    // Hashes trimmed pixels, decodes the image if pixels aren't loaded.
+    // Returns false if pixels couldn't be decoded.
+    bool updateHash();
+
+    // Compares pixels, decodes images which pixels aren't loaded.
+    bool isSame(const cImage& other) const;
+
+    // Same, pixels of other image are given by caller, e.g. decoded once
+    // to be compared with many images.
+    bool isSame(const cImage& other, const cBitmap& otherPixels) const;
+
+    uint64_t getHash() const
+    {
+        return m_hash;
+    }
+
+    // Images with the same pixels, packed once with this one.
+    void addAlias(const cImage* image)
+    {
+        m_aliases.push_back(image);
+    }
+
+    const std::vector<const cImage*>& getAliases() const
+    {
+        return m_aliases;
+    }
 
     const cBitmap& getBitmap() const
     {
         return m_bitmap;
     }
 
+    const sSize& getSize() const
+    {
+        return m_size;
+    }
+
     const sSize& getOriginalSize() const
     {
         return m_originalSize;
@@ -51,13 +94,24 @@ public:
         return m_spriteId;
     }
 
+private:
+    bool setName(const char* path, uint32_t trimPath);
+    void setInfo(const sSpriteInfo& info);
+
 private:
     std::string m_name;
     std::string m_spriteId;
 
     sSize m_originalSize;
+    sSize m_size;
     sOffset m_offset;
 
+    uint64_t m_hash = 0u;
+    std::vector<const cImage*> m_aliases;
+
+    const cSpriteCache* m_cache = nullptr;
+    std::unique_ptr<cMappedFile> m_cacheFile;
+
     uint8_t* m_stbImageData = nullptr;
     cBitmap m_bitmap;
 };
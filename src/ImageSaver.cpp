@@ -7,6 +7,9 @@
 \**********************************************/
 
 #include "ImageSaver.h"
+#include "File.h"
+#include "PngWriter.h"
+#include "Utils.h"
 #include "Types/Bitmap.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -14,9 +17,11 @@
 
 #include <algorithm>
 #include <cstring>
+#include <vector>
 
-cImageSaver::cImageSaver(const cBitmap& bitmap, const char* filename)
-    : m_bitmap(bitmap)
+cImageSaver::cImageSaver(const sConfig& config, const cBitmap& bitmap, const char* filename)
+    : m_config(config)
+    , m_bitmap(bitmap)
     , m_filename(filename)
 {
     m_type = getWriter(filename);
@@ -64,27 +69,70 @@ cImageSaver::Type cImageSaver::getWriter(const char* filename) const
     return Type::unknown;
 }
 
-bool cImageSaver::save() const
+bool cImageSaver::save(const cWorkerPool& workers)
+{
+    const auto startTime = getCurrentTime();
+    if (write(workers) == false)
+    {
+        return false;
+    }
+    m_saveTime = getCurrentTime() - startTime;
+
+    cFile file;
+    if (file.open(m_filename.c_str()))
+    {
+        m_fileSize = static_cast<uint64_t>(file.getSize());
+    }
+
+    return true;
+}
+
+float cImageSaver::getSpeed() const
 {
+    auto& size = m_bitmap.getSize();
+    const uint64_t bytes = uint64_t(size.width) * size.height * sizeof(cBitmap::Pixel);
+    return bytes / float(std::max<uint64_t>(m_saveTime, 1u));
+}
+
+bool cImageSaver::write(const cWorkerPool& workers) const
+{
+    if (m_type == Type::png || m_type == Type::unknown)
+    {
+        cPngWriter writer(m_config, workers);
+        return writer.save(m_bitmap, m_filename.c_str());
+    }
+
     auto& size = m_bitmap.getSize();
     const int w = size.width;
     const int h = size.height;
-    const int stride = w * 4;
-    const auto data = m_bitmap.getData();
+    const void* data = m_bitmap.getData();
 
     auto filename = m_filename.c_str();
 
-    switch (m_type)
+    std::vector<cBitmap::Pixel> packed;
+    if (m_bitmap.getPitch() != size.width)
     {
-    case Type::unknown:
-    case Type::png:
-        return stbi_write_png(filename, w, h, 4, data, stride) != 0;
+        packed.resize(size_t(size.width) * size.height);
+        auto src = m_bitmap.getData();
+        for (uint32_t y = 0; y < size.height; y++)
+        {
+            std::copy(src, src + size.width, packed.data() + size_t(y) * size.width);
+            src += m_bitmap.getPitch();
+        }
+        data = packed.data();
+    }
 
+    switch (m_type)
+    {
     case Type::bmp:
         return stbi_write_bmp(filename, w, h, 4, data) != 0;
 
     case Type::tga:
         return stbi_write_tga(filename, w, h, 4, data) != 0;
+
+    case Type::png:
+    case Type::unknown:
+        break;
     }
 
     return false;
@@ -8,14 +8,17 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 class cBitmap;
+class cWorkerPool;
+struct sConfig;
 
 class cImageSaver final
 {
 public:
-    cImageSaver(const cBitmap& bitmap, const char* filename);
+    cImageSaver(const sConfig& config, const cBitmap& bitmap, const char* filename);
     ~cImageSaver();
 
     const char* getAtlasName() const
@@ -23,7 +26,17 @@ public:
         return m_filename.c_str();
     }
 
-    bool save() const;
+    // PNG is encoded by workers, BMP and TGA are written by single thread.
+    bool save(const cWorkerPool& workers);
+
+    // written file size in bytes
+    uint64_t getFileSize() const
+    {
+        return m_fileSize;
+    }
+
+    // raw pixels encoded per second, MB
+    float getSpeed() const;
 
 private:
     enum class Type
@@ -35,10 +48,15 @@ private:
     };
 
     Type getWriter(const char* filename) const;
+    bool write(const cWorkerPool& workers) const;
 
 private:
+    const sConfig& m_config;
     const cBitmap& m_bitmap;
     std::string m_filename;
 
     Type m_type;
+
+    uint64_t m_fileSize = 0u;
+    uint64_t m_saveTime = 0u; // us
 };
@@ -0,0 +1,426 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "PngWriter.h"
+#include "Deflate.h"
+#include "File.h"
+#include "Utils.h"
+#include "Types/Bitmap.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+    const uint32_t BytesPerPixel = 4u;
+    const uint32_t BandsPerThread = 4u;
+    const size_t ChunkSize = 256u * 1024u; // input of one deflate job
+
+    enum Filter : uint8_t
+    {
+        None,
+        Sub,
+        Up,
+        Average,
+        Paeth,
+
+        Count
+    };
+
+    // strategy of filter choice per row by sum of absolute values
+    const uint32_t Adaptive = Filter::Count;
+
+    // one filter for all rows costs a single pass
+    const uint32_t FastFilter = Filter::Up;
+
+    // tried by max preset until half of time budget is over, the default one goes first
+    const uint32_t Strategies[] = { Adaptive, Filter::Up, Filter::Sub, Filter::Paeth, Filter::Average, Filter::None };
+
+    struct sPresetName
+    {
+        PngPreset preset;
+        const char* name;
+    };
+
+    const sPresetName PresetNames[] = {
+        { PngPreset::Fast, "fast" },
+        { PngPreset::Default, "default" },
+        { PngPreset::Max, "max" },
+    };
+
+    uint8_t GetPaeth(uint8_t a, uint8_t b, uint8_t c)
+    {
+        const int p = int(a) + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc)
+        {
+            return a;
+        }
+        return pb <= pc ? b : c;
+    }
+
+    void ApplyFilter(uint32_t filter, const uint8_t* row, const uint8_t* prev, uint32_t size, uint8_t* out)
+    {
+        const uint32_t bpp = std::min(BytesPerPixel, size);
+        switch (filter)
+        {
+        case Filter::None:
+            ::memcpy(out, row, size);
+            break;
+
+        case Filter::Sub:
+            ::memcpy(out, row, bpp);
+            for (uint32_t i = bpp; i < size; i++)
+            {
+                out[i] = row[i] - row[i - BytesPerPixel];
+            }
+            break;
+
+        case Filter::Up:
+            for (uint32_t i = 0; i < size; i++)
+            {
+                out[i] = row[i] - prev[i];
+            }
+            break;
+
+        case Filter::Average:
+            for (uint32_t i = 0; i < bpp; i++)
+            {
+                out[i] = row[i] - (prev[i] >> 1);
+            }
+            for (uint32_t i = bpp; i < size; i++)
+            {
+                out[i] = row[i] - uint8_t((row[i - BytesPerPixel] + prev[i]) >> 1);
+            }
+            break;
+
+        case Filter::Paeth:
+            for (uint32_t i = 0; i < bpp; i++)
+            {
+                out[i] = row[i] - prev[i];
+            }
+            for (uint32_t i = bpp; i < size; i++)
+            {
+                out[i] = row[i] - GetPaeth(row[i - BytesPerPixel], prev[i], prev[i - BytesPerPixel]);
+            }
+            break;
+        }
+    }
+
+    // Applies every filter and keeps one with minimal sum of absolute
+    // values of signed bytes, out is filter type byte followed by row.
+    void FilterAdaptive(const uint8_t* row, const uint8_t* prev, uint32_t size, uint8_t* scratch, uint8_t* out)
+    {
+        uint8_t* filtered[Filter::Count];
+        for (uint32_t f = 0; f < Filter::Count; f++)
+        {
+            filtered[f] = scratch + size_t(f) * size;
+            ApplyFilter(f, row, prev, size, filtered[f]);
+        }
+
+        uint32_t best = Filter::None;
+        uint64_t bestScore = UINT64_MAX;
+        for (uint32_t f = 0; f < Filter::Count; f++)
+        {
+            uint64_t score = 0u;
+            for (uint32_t i = 0; i < size; i++)
+            {
+                score += std::abs(int(int8_t(filtered[f][i])));
+            }
+
+            if (score < bestScore)
+            {
+                bestScore = score;
+                best = f;
+            }
+        }
+
+        out[0] = static_cast<uint8_t>(best);
+        ::memcpy(out + 1, filtered[best], size);
+    }
+
+    uint32_t GetCrc32(const uint8_t* data, size_t size, uint32_t crc = 0u)
+    {
+        static const auto Table = [] {
+            std::vector<uint32_t> table(256);
+            for (uint32_t n = 0; n < 256u; n++)
+            {
+                uint32_t c = n;
+                for (uint32_t k = 0; k < 8u; k++)
+                {
+                    c = (c & 1u) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                table[n] = c;
+            }
+            return table;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = Table[(crc ^ data[i]) & 0xffu] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void PutBigEndian(uint8_t* out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value >> 24);
+        out[1] = static_cast<uint8_t>(value >> 16);
+        out[2] = static_cast<uint8_t>(value >> 8);
+        out[3] = static_cast<uint8_t>(value);
+    }
+
+    bool WriteChunk(cFile& file, const char* type, uint8_t* data, uint32_t size)
+    {
+        uint8_t header[8];
+        PutBigEndian(header, size);
+        ::memcpy(header + 4, type, 4);
+
+        uint8_t crc[4];
+        PutBigEndian(crc, GetCrc32(data, size, GetCrc32(header + 4, 4)));
+
+        return file.write(header, sizeof(header)) == sizeof(header)
+            && (size == 0u || file.write(data, size) == size)
+            && file.write(crc, sizeof(crc)) == sizeof(crc);
+    }
+
+} // namespace
+
+const char* cPngWriter::GetPresetName(PngPreset preset)
+{
+    for (auto& p : PresetNames)
+    {
+        if (p.preset == preset)
+        {
+            return p.name;
+        }
+    }
+
+    return "unknown";
+}
+
+bool cPngWriter::ParsePreset(const char* name, PngPreset& preset)
+{
+    for (auto& p : PresetNames)
+    {
+        if (::strcmp(p.name, name) == 0)
+        {
+            preset = p.preset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+cPngWriter::cPngWriter(const sConfig& config, const cWorkerPool& workers)
+    : m_config(config)
+    , m_workers(workers)
+{
+}
+
+void cPngWriter::filter(const cBitmap& bitmap, uint32_t strategy, std::vector<uint8_t>& filtered) const
+{
+    const auto& size = bitmap.getSize();
+    const uint32_t rowSize = size.width * BytesPerPixel;
+    const size_t filteredRow = size_t(rowSize) + 1u;
+
+    auto pixels = reinterpret_cast<const uint8_t*>(bitmap.getData());
+    const size_t pitch = size_t(bitmap.getPitch()) * BytesPerPixel;
+
+    // filter choice of a row depends only on raw pixels, bands are independent
+    filtered.resize(filteredRow * size.height);
+    const uint32_t bandsCount = std::max(1u, std::min(size.height, m_workers.getThreadsCount() * BandsPerThread));
+    const std::vector<uint8_t> zeros(rowSize, 0u);
+    m_workers.run(bandsCount, [&](uint32_t idx, uint32_t /*worker*/) {
+        const uint32_t begin = uint32_t(uint64_t(size.height) * idx / bandsCount);
+        const uint32_t end = uint32_t(uint64_t(size.height) * (idx + 1u) / bandsCount);
+
+        std::vector<uint8_t> scratch(strategy == Adaptive ? size_t(rowSize) * Filter::Count : 0u);
+        for (uint32_t y = begin; y < end; y++)
+        {
+            const uint8_t* row = pixels + pitch * y;
+            const uint8_t* prev = y != 0u ? row - pitch : zeros.data();
+            auto out = filtered.data() + filteredRow * y;
+            if (strategy == Adaptive)
+            {
+                FilterAdaptive(row, prev, rowSize, scratch.data(), out);
+            }
+            else
+            {
+                out[0] = static_cast<uint8_t>(strategy);
+                ApplyFilter(strategy, row, prev, rowSize, out + 1);
+            }
+        }
+    });
+}
+
+size_t cPngWriter::deflate(const std::vector<uint8_t>& filtered, cDeflate::Level level, uint64_t deadline,
+                           Chunks& chunks, uint32_t& downgraded) const
+{
+    // every chunk ends on byte boundary and may refer to the tail of previous one
+    const size_t total = filtered.size();
+    const auto chunksCount = static_cast<uint32_t>(std::max<size_t>(1u, (total + ChunkSize - 1u) / ChunkSize));
+    chunks.assign(chunksCount, {});
+    std::vector<uint32_t> adlers(chunksCount);
+    std::vector<uint8_t> isDowngraded(chunksCount, 0u);
+    m_workers.run(chunksCount, [&](uint32_t idx, uint32_t /*worker*/) {
+        const size_t begin = ChunkSize * idx;
+        const size_t end = std::min(total, begin + ChunkSize);
+        const size_t dictSize = std::min<size_t>(begin, cDeflate::WindowSize);
+        const bool isFinal = idx + 1u == chunksCount;
+
+        auto& out = chunks[idx];
+        if (idx == 0u)
+        {
+            // zlib header: deflate with 32 KiB window, level hint by effort
+            static const uint8_t Flags[] = { 0x01, 0x9c, 0xda };
+            out.push_back(0x78);
+            out.push_back(Flags[static_cast<uint32_t>(level)]);
+        }
+        auto chunkLevel = level;
+        if (deadline != 0u && level != cDeflate::Level::Default && getCurrentTime() > deadline)
+        {
+            chunkLevel = cDeflate::Level::Default;
+            isDowngraded[idx] = 1u;
+        }
+        cDeflate::Compress(filtered.data() + begin, end - begin, dictSize, isFinal, chunkLevel, out);
+        adlers[idx] = cDeflate::Adler32(filtered.data() + begin, end - begin);
+    });
+
+    downgraded = static_cast<uint32_t>(std::count(isDowngraded.begin(), isDowngraded.end(), 1u));
+
+    uint32_t adler = adlers[0];
+    for (uint32_t i = 1; i < chunksCount; i++)
+    {
+        const size_t chunkSize = std::min(total, ChunkSize * (i + 1u)) - ChunkSize * i;
+        adler = cDeflate::Adler32Combine(adler, adlers[i], chunkSize);
+    }
+    auto& last = chunks.back();
+    last.resize(last.size() + 4u);
+    PutBigEndian(last.data() + last.size() - 4u, adler);
+
+    size_t size = 0u;
+    for (auto& chunk : chunks)
+    {
+        size += chunk.size();
+    }
+    return size;
+}
+
+bool cPngWriter::save(const cBitmap& bitmap, const char* filename) const
+{
+    std::vector<uint8_t> filtered;
+    Chunks chunks;
+
+    uint32_t downgraded = 0u;
+    switch (m_config.pngPreset)
+    {
+    case PngPreset::Fast:
+        filter(bitmap, FastFilter, filtered);
+        deflate(filtered, cDeflate::Level::Fast, 0u, chunks, downgraded);
+        break;
+
+    case PngPreset::Default:
+        filter(bitmap, Adaptive, filtered);
+        deflate(filtered, cDeflate::Level::Default, 0u, chunks, downgraded);
+        break;
+
+    case PngPreset::Max:
+        {
+            // strategies are compared by default deflate in the first half of
+            // budget, then the winner is compressed again with optimal parse,
+            // default stream stays if optimal one isn't smaller
+            const auto startTime = getCurrentTime();
+            const uint64_t budget = m_config.pngBudget * 1000ull;
+            const auto searchDeadline = startTime + budget / 2u;
+            const auto deadline = startTime + budget;
+
+            const auto strategiesCount = static_cast<uint32_t>(sizeof(Strategies) / sizeof(Strategies[0]));
+            uint32_t tried = 0u;
+            size_t bestSize = SIZE_MAX;
+            Chunks bestChunks;
+            std::vector<uint8_t> candidate;
+            while (tried < strategiesCount)
+            {
+                filter(bitmap, Strategies[tried++], candidate);
+                const auto size = deflate(candidate, cDeflate::Level::Default, 0u, chunks, downgraded);
+                if (size < bestSize)
+                {
+                    bestSize = size;
+                    std::swap(filtered, candidate);
+                    std::swap(bestChunks, chunks);
+                }
+
+                if (getCurrentTime() > searchDeadline)
+                {
+                    break;
+                }
+            }
+
+            if (deflate(filtered, cDeflate::Level::Best, deadline, chunks, downgraded) >= bestSize)
+            {
+                std::swap(chunks, bestChunks);
+            }
+
+            if (tried < strategiesCount || downgraded != 0u)
+            {
+                ::printf("(WW) PNG budget %u ms is over: %u of %u filter strategies tried, %u of %u chunks compressed with default level.\n",
+                         m_config.pngBudget,
+                         tried,
+                         strategiesCount,
+                         downgraded,
+                         static_cast<uint32_t>(chunks.size()));
+            }
+        }
+        break;
+    }
+
+    cFile file;
+    if (file.open(filename, "wb") == false)
+    {
+        return false;
+    }
+
+    uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    if (file.write(signature, sizeof(signature)) != sizeof(signature))
+    {
+        return false;
+    }
+
+    // 8 bit RGBA, no interlace
+    const auto& size = bitmap.getSize();
+    uint8_t header[13] = {};
+    PutBigEndian(header, size.width);
+    PutBigEndian(header + 4, size.height);
+    header[8] = 8u;
+    header[9] = 6u;
+    if (WriteChunk(file, "IHDR", header, sizeof(header)) == false)
+    {
+        return false;
+    }
+
+    // one IDAT per deflated chunk, decoders join them back
+    for (auto& chunk : chunks)
+    {
+        if (WriteChunk(file, "IDAT", chunk.data(), static_cast<uint32_t>(chunk.size())) == false)
+        {
+            return false;
+        }
+    }
+
+    return WriteChunk(file, "IEND", nullptr, 0u);
+}
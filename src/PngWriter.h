@@ -0,0 +1,48 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "Config.h"
+#include "Deflate.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class cBitmap;
+class cWorkerPool;
+
+// RGBA PNG writer. Rows are filtered by bands and the filtered data is
+// deflated by chunks in parallel, each chunk primed with 32 KiB before it,
+// then chunks are joined into a single zlib stream.
+class cPngWriter final
+{
+public:
+    static const char* GetPresetName(PngPreset preset);
+    static bool ParsePreset(const char* name, PngPreset& preset);
+
+public:
+    cPngWriter(const sConfig& config, const cWorkerPool& workers);
+
+    bool save(const cBitmap& bitmap, const char* filename) const;
+
+private:
+    using Chunks = std::vector<std::vector<uint8_t>>;
+
+    void filter(const cBitmap& bitmap, uint32_t strategy, std::vector<uint8_t>& filtered) const;
+
+    // Returns size of zlib stream. Chunks not started before deadline (0 - none)
+    // are compressed with default level, their count goes to downgraded.
+    size_t deflate(const std::vector<uint8_t>& filtered, cDeflate::Level level, uint64_t deadline,
+                   Chunks& chunks, uint32_t& downgraded) const;
+
+private:
+    const sConfig& m_config;
+    const cWorkerPool& m_workers;
+};
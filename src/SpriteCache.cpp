@@ -0,0 +1,208 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "SpriteCache.h"
+#include "Config.h"
+#include "File.h"
+#include "Utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+    const char Magic[4] = { 'T', 'P', 'S', 'C' };
+    const uint32_t Version = 1u;
+
+    struct sHeader
+    {
+        char magic[4];
+        uint32_t version;
+
+        uint64_t fileSize;
+        int64_t mtimeSec;
+        int64_t mtimeNsec;
+        uint32_t flags;
+
+        uint32_t originalWidth;
+        uint32_t originalHeight;
+        uint32_t offsetX;
+        uint32_t offsetY;
+        uint32_t width;
+        uint32_t height;
+
+        // path follows the header, pixels start at dataOffset
+        uint32_t pathLength;
+        uint32_t dataOffset;
+    };
+
+    uint32_t AlignUp(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1u) & ~(alignment - 1u);
+    }
+
+} // namespace
+
+cSpriteCache::cSpriteCache(const char* dir, const sConfig& config)
+    : m_config(config)
+    , m_dir(dir)
+{
+    if (m_dir.length() > 1 && m_dir[m_dir.length() - 1] == '/')
+    {
+        m_dir.pop_back();
+    }
+
+    ::mkdir(m_dir.c_str(), 0755);
+}
+
+bool cSpriteCache::getKey(const char* path, sKey& key) const
+{
+    struct stat st;
+    if (::stat(path, &st) != 0)
+    {
+        return false;
+    }
+
+    key.fileSize = static_cast<uint64_t>(st.st_size);
+    key.mtimeSec = static_cast<int64_t>(st.st_mtim.tv_sec);
+    key.mtimeNsec = static_cast<int64_t>(st.st_mtim.tv_nsec);
+    key.flags = m_config.trim ? (1u | (m_config.alphaThreshold << 8)) : 0u;
+
+    return true;
+}
+
+std::string cSpriteCache::getRecordPath(const char* path, uint32_t flags) const
+{
+    // file size and time stay out of the name, stale record is replaced
+    auto hash = getHash(path, ::strlen(path));
+    hash = getHash(&flags, sizeof(flags), hash);
+
+    char name[24];
+    ::snprintf(name, sizeof(name), "/%016llx.spr", static_cast<unsigned long long>(hash));
+
+    return m_dir + name;
+}
+
+bool cSpriteCache::find(const char* path, cMappedFile& file, sSpriteInfo& info, const cBitmap::Pixel*& pixels) const
+{
+    sKey key;
+    if (getKey(path, key) == false)
+    {
+        return false;
+    }
+
+    auto recordPath = getRecordPath(path, key.flags);
+    if (file.open(recordPath.c_str()) == false || file.getSize() < sizeof(sHeader))
+    {
+        file.close();
+        return false;
+    }
+
+    sHeader header;
+    ::memcpy(&header, file.getData(), sizeof(header));
+
+    const auto pathLength = static_cast<uint32_t>(::strlen(path));
+    const uint64_t dataSize = uint64_t(header.width) * header.height * sizeof(cBitmap::Pixel);
+
+    const bool isValid = ::memcmp(header.magic, Magic, sizeof(Magic)) == 0
+        && header.version == Version
+        && header.fileSize == key.fileSize
+        && header.mtimeSec == key.mtimeSec
+        && header.mtimeNsec == key.mtimeNsec
+        && header.flags == key.flags
+        && header.pathLength == pathLength
+        && sizeof(sHeader) + pathLength <= header.dataOffset
+        && header.dataOffset + dataSize == file.getSize()
+        && ::memcmp(file.getData() + sizeof(sHeader), path, pathLength) == 0;
+
+    if (isValid == false)
+    {
+        file.close();
+        return false;
+    }
+
+    info.originalSize = { header.originalWidth, header.originalHeight };
+    info.offset = { header.offsetX, header.offsetY };
+    info.size = { header.width, header.height };
+    pixels = reinterpret_cast<const cBitmap::Pixel*>(file.getData() + header.dataOffset);
+
+    return true;
+}
+
+bool cSpriteCache::store(const char* path, const sSpriteInfo& info, const cBitmap::Pixel* pixels, uint32_t pitch) const
+{
+    sKey key;
+    if (getKey(path, key) == false)
+    {
+        return false;
+    }
+
+    const auto pathLength = static_cast<uint32_t>(::strlen(path));
+
+    sHeader header;
+    ::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.fileSize = key.fileSize;
+    header.mtimeSec = key.mtimeSec;
+    header.mtimeNsec = key.mtimeNsec;
+    header.flags = key.flags;
+    header.originalWidth = info.originalSize.width;
+    header.originalHeight = info.originalSize.height;
+    header.offsetX = info.offset.x;
+    header.offsetY = info.offset.y;
+    header.width = info.size.width;
+    header.height = info.size.height;
+    header.pathLength = pathLength;
+    header.dataOffset = AlignUp(sizeof(sHeader) + pathLength, 64u);
+
+    // write to temporary file first, concurrent runs never see partial record
+    const auto recordPath = getRecordPath(path, key.flags);
+    const auto tempPath = recordPath + "." + std::to_string(::getpid())
+        + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    bool result = false;
+    {
+        cFile file;
+        if (file.open(tempPath.c_str(), "wb") == false)
+        {
+            return false;
+        }
+
+        const uint8_t zeroes[64] = {};
+        const uint32_t rowSize = info.size.width * sizeof(cBitmap::Pixel);
+
+        result = file.write(&header, sizeof(header)) == sizeof(header)
+            && file.write(const_cast<char*>(path), pathLength) == pathLength;
+
+        const uint32_t gap = header.dataOffset - sizeof(sHeader) - pathLength;
+        result = result && file.write(const_cast<uint8_t*>(zeroes), gap) == gap;
+
+        for (uint32_t y = 0; result && y < info.size.height; y++)
+        {
+            auto row = const_cast<cBitmap::Pixel*>(pixels + y * pitch);
+            result = file.write(row, rowSize) == rowSize;
+        }
+    }
+
+    if (result)
+    {
+        result = ::rename(tempPath.c_str(), recordPath.c_str()) == 0;
+    }
+
+    if (result == false)
+    {
+        ::unlink(tempPath.c_str());
+    }
+
+    return result;
+}
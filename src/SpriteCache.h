@@ -0,0 +1,58 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include "Types/Bitmap.h"
+
+#include <string>
+
+class cMappedFile;
+struct sConfig;
+
+struct sSpriteInfo
+{
+    sSize originalSize;
+    sOffset offset;
+    sSize size;
+};
+
+// Keeps decoded and trimmed sprites on disk, one record per input file.
+// Record is named by path and trim settings, file size and modification
+// time are checked from its header, so edited sprite overwrites its record.
+// Pixels are stored uncompressed right after the header to be mapped as is.
+class cSpriteCache final
+{
+public:
+    cSpriteCache(const char* dir, const sConfig& config);
+
+    const std::string& getDir() const
+    {
+        return m_dir;
+    }
+
+    // Maps cached record, pixels point into the mapped file.
+    bool find(const char* path, cMappedFile& file, sSpriteInfo& info, const cBitmap::Pixel*& pixels) const;
+    bool store(const char* path, const sSpriteInfo& info, const cBitmap::Pixel* pixels, uint32_t pitch) const;
+
+private:
+    struct sKey
+    {
+        uint64_t fileSize;
+        int64_t mtimeSec;
+        int64_t mtimeNsec;
+        uint32_t flags;
+    };
+
+    bool getKey(const char* path, sKey& key) const;
+    std::string getRecordPath(const char* path, uint32_t flags) const;
+
+private:
+    const sConfig& m_config;
+    std::string m_dir;
+};
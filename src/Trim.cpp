@@ -7,184 +7,241 @@
 \**********************************************/
 
 #include "Trim.h"
-#include "Atlas/AtlasSize.h"
-#include "Config.h"
 
+#include <algorithm>
 #include <cstdio>
 
-bool cTrim::doTrim(const cBitmap& input, cBitmap& output, sOffset& offset) const
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
 {
-    auto left = findLeft(input);
-    auto right = findRigth(input);
-    auto top = findTop(input);
-    auto bottom = findBottom(input);
 
-    auto& size = input.getSize();
-    // printf("  source size: %u x %u\n", size.width, size.height);
+    using Pixel = cBitmap::Pixel;
 
-    if (left == 0 && right == size.width - 1 && top == 0 && bottom == size.height - 1)
+    bool IsOpaque(const Pixel& p, uint8_t threshold)
     {
-        // printf("  original size\n");
-        return false;
+        return p.a > threshold;
     }
-    else if (left > right || top > bottom)
+
+#if defined(__AVX2__)
+
+    const uint32_t Lanes = 8u;
+
+    // bit per pixel, set if alpha is above threshold
+    uint32_t GetOpaqueMask(const Pixel* src, uint8_t threshold)
     {
-        // printf("  empty sprite\n");
-        return true;
+        auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        auto alpha = _mm256_srli_epi32(px, 24);
+        auto cmp = _mm256_cmpgt_epi32(alpha, _mm256_set1_epi32(threshold));
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(cmp)));
     }
 
-    // printf("  new rect: %u <-> %u , %u <-> %u\n", left, right, top, bottom);
-    offset = { left, top };
+#elif defined(__SSE2__)
+
+    const uint32_t Lanes = 4u;
 
-    auto src = input.getData() + top * size.width;
+    uint32_t GetOpaqueMask(const Pixel* src, uint8_t threshold)
+    {
+        auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        auto alpha = _mm_srli_epi32(px, 24);
+        auto cmp = _mm_cmpgt_epi32(alpha, _mm_set1_epi32(threshold));
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(cmp)));
+    }
 
-    auto width = right - left + 1;
-    auto height = bottom - top + 1;
+#elif defined(__ARM_NEON)
 
-    output.createBitmap({ width, height });
-    auto dst = output.getData();
+    const uint32_t Lanes = 4u;
 
-    for (uint32_t y = top; y <= bottom; y++)
+    uint32_t GetOpaqueMask(const Pixel* src, uint8_t threshold)
     {
-        for (uint32_t x = left; x <= right; x++)
-        {
-            *dst++ = src[x];
-        }
-        src += size.width;
+        auto px = vld1q_u32(reinterpret_cast<const uint32_t*>(src));
+        auto cmp = vcgtq_u32(vshrq_n_u32(px, 24), vdupq_n_u32(threshold));
+        const uint32x4_t bits = { 1u, 2u, 4u, 8u };
+        return vaddvq_u32(vandq_u32(cmp, bits));
     }
 
-    return true;
-}
+#else
 
-bool cTrim::trim(const char* /*path*/, const cBitmap& input)
-{
-    // printf("Trim begin: '%s'\n", path);
+    const uint32_t Lanes = 1u;
 
-    m_bitmap.clear();
-    m_offset = { 0u, 0u };
+    uint32_t GetOpaqueMask(const Pixel* src, uint8_t threshold)
+    {
+        return IsOpaque(*src, threshold) ? 1u : 0u;
+    }
 
-    auto result = doTrim(input, m_bitmap, m_offset);
+#endif
 
-    // printf("  trim end.\n");
-    // fflush(nullptr);
+    // Index of the first opaque pixel in [begin, end) or end.
+    uint32_t FindFirst(const Pixel* row, uint32_t begin, uint32_t end, uint8_t threshold)
+    {
+        auto x = begin;
+        for (; x + Lanes <= end; x += Lanes)
+        {
+            auto mask = GetOpaqueMask(row + x, threshold);
+            if (mask != 0u)
+            {
+                return x + static_cast<uint32_t>(__builtin_ctz(mask));
+            }
+        }
 
-    return result;
-}
+        for (; x < end; x++)
+        {
+            if (IsOpaque(row[x], threshold))
+            {
+                return x;
+            }
+        }
 
-uint32_t cTrim::findLeft(const cBitmap& input) const
-{
-    auto& size = input.getSize();
-    for (uint32_t x = 0u; x < size.width; x++)
+        return end;
+    }
+
+    // Index of the last opaque pixel in [begin, end) or end.
+    uint32_t FindLast(const Pixel* row, uint32_t begin, uint32_t end, uint8_t threshold)
     {
-        auto src = input.getData() + x;
-        for (uint32_t y = 0u; y < size.height; y++)
+        auto x = end;
+        for (; x >= begin + Lanes; x -= Lanes)
+        {
+            auto mask = GetOpaqueMask(row + x - Lanes, threshold);
+            if (mask != 0u)
+            {
+                return x - Lanes + 31u - static_cast<uint32_t>(__builtin_clz(mask));
+            }
+        }
+
+        while (x > begin)
         {
-            if (src->a != 0)
+            x--;
+            if (IsOpaque(row[x], threshold))
             {
                 return x;
             }
-            src += size.width;
         }
+
+        return end;
     }
 
-    return size.width;
+} // namespace
+
+cTrim::cTrim(uint32_t alphaThreshold)
+    : m_alphaThreshold(static_cast<uint8_t>(std::min(alphaThreshold, 255u)))
+{
 }
 
-uint32_t cTrim::findRigth(const cBitmap& input) const
+bool cTrim::findBounds(const cBitmap& input, uint32_t& left, uint32_t& top, uint32_t& right, uint32_t& bottom) const
 {
     auto& size = input.getSize();
-    for (uint32_t x = 0; x < size.width; x++)
+    const auto width = size.width;
+    const auto height = size.height;
+    const auto pitch = input.getPitch();
+    const auto data = input.getData();
+    const auto threshold = m_alphaThreshold;
+
+    // top row: the first one with any opaque pixel
+    for (top = 0; top < height; top++)
     {
-        uint32_t offset = size.width - x - 1;
-        auto src = input.getData() + offset;
-        for (uint32_t y = 0; y < size.height; y++)
+        auto row = data + top * pitch;
+        left = FindFirst(row, 0, width, threshold);
+        if (left != width)
         {
-            if (src->a != 0)
-            {
-                return offset;
-            }
-            src += size.width;
+            right = FindLast(row, left, width, threshold);
+            break;
         }
     }
 
-    return 0;
-}
+    if (top == height)
+    {
+        return false;
+    }
 
-uint32_t cTrim::findTop(const cBitmap& input) const
-{
-    auto& size = input.getSize();
-    for (uint32_t y = 0; y < size.height; y++)
+    // bottom row: the last one with any opaque pixel
+    for (bottom = height - 1; bottom > top; bottom--)
     {
-        auto src = input.getData() + y * size.width;
-        for (uint32_t x = 0; x < size.width; x++)
+        auto row = data + bottom * pitch;
+        auto first = FindFirst(row, 0, width, threshold);
+        if (first != width)
         {
-            if (src->a != 0)
+            left = std::min(left, first);
+            auto last = FindLast(row, std::max(first, right + 1), width, threshold);
+            if (last != width)
             {
-                return y;
+                right = last;
             }
-            src++;
+            break;
         }
     }
 
-    return size.height;
-}
-
-uint32_t cTrim::findBottom(const cBitmap& input) const
-{
-    auto& size = input.getSize();
-    for (uint32_t y = 0; y < size.height; y++)
+    // rows in between can only widen the bounds, so only the margins are checked
+    for (uint32_t y = top + 1; y < bottom; y++)
     {
-        uint32_t offset = size.height - y - 1;
-        auto src = input.getData() + offset * size.width;
-        for (uint32_t x = 0; x < size.width; x++)
+        auto row = data + y * pitch;
+        if (left > 0)
+        {
+            left = FindFirst(row, 0, left, threshold);
+        }
+        if (right + 1 < width)
         {
-            if (src->a != 0)
+            auto last = FindLast(row, right + 1, width, threshold);
+            if (last != width)
             {
-                return offset;
+                right = last;
             }
-            src++;
         }
     }
 
-    return 0;
-}
-
-cTrimRigthBottom::cTrimRigthBottom(const sConfig& config)
-    : cTrim()
-    , m_config(config)
-{
+    return true;
 }
 
-bool cTrimRigthBottom::trim(const char* /*path*/, const cBitmap& input)
+bool cTrim::getBounds(const cBitmap& input, sOffset& offset, sSize& size) const
 {
-    m_bitmap.clear();
-
-    const auto border = m_config.border;
+    uint32_t left;
+    uint32_t top;
+    uint32_t right;
+    uint32_t bottom;
+    const bool isEmpty = findBounds(input, left, top, right, bottom) == false;
 
-    const auto width = cAtlasSize::FixSize(findRigth(input) + border, m_config.pot);
-    const auto height = cAtlasSize::FixSize(findBottom(input) + border, m_config.pot);
+    auto& inputSize = input.getSize();
+    // printf("  source size: %u x %u\n", inputSize.width, inputSize.height);
 
-    auto& size = input.getSize();
-    if (width == size.width && height == size.height)
+    if (isEmpty)
+    {
+        // printf("  empty sprite\n");
+        offset = { 0u, 0u };
+        size = { 0u, 0u };
+        return true;
+    }
+    else if (left == 0 && right == inputSize.width - 1 && top == 0 && bottom == inputSize.height - 1)
     {
+        // printf("  original size\n");
         return false;
     }
 
-    // printf("Trim %s %u x %u -> %u x %u \n", path, size.width, size.height, width, height);
+    // printf("  new rect: %u <-> %u , %u <-> %u\n", left, right, top, bottom);
+    offset = { left, top };
+    size = { right - left + 1, bottom - top + 1 };
 
-    auto src = input.getData();
+    return true;
+}
 
-    m_bitmap.createBitmap({ width, height });
-    auto dst = m_bitmap.getData();
+bool cTrim::trim(const char* /*path*/, const cBitmap& input)
+{
+    // printf("Trim begin: '%s'\n", path);
+
+    m_bitmap.clear();
+    m_offset = { 0u, 0u };
 
-    for (uint32_t y = 0; y < height; y++)
+    sSize size;
+    auto result = getBounds(input, m_offset, size);
+    if (result)
     {
-        for (uint32_t x = 0; x < width; x++)
-        {
-            *dst++ = src[x];
-        }
-        src += size.width;
+        m_bitmap.setView(input, m_offset, size);
     }
 
-    return true;
+    // printf("  trim end.\n");
+    // fflush(nullptr);
+
+    return result;
 }
@@ -10,15 +10,20 @@
 
 #include "Types/Bitmap.h"
 
-struct sConfig;
-
 class cTrim
 {
 public:
+    // Pixels with alpha not greater than threshold are treated as transparent.
+    explicit cTrim(uint32_t alphaThreshold);
     virtual ~cTrim() = default;
 
+    // Trimmed bitmap is a view into input, no pixels are copied.
     virtual bool trim(const char* path, const cBitmap& input);
 
+    // Calculates the non-transparent region without copying pixels.
+    // Returns false if the whole bitmap is used.
+    bool getBounds(const cBitmap& input, sOffset& offset, sSize& size) const;
+
     const cBitmap& getBitmap() const
     {
         return m_bitmap;
@@ -30,24 +35,13 @@ public:
     }
 
 protected:
-    bool doTrim(const cBitmap& input, cBitmap& output, sOffset& offset) const;
-    uint32_t findLeft(const cBitmap& input) const;
-    uint32_t findRigth(const cBitmap& input) const;
-    uint32_t findTop(const cBitmap& input) const;
-    uint32_t findBottom(const cBitmap& input) const;
+
+    // Single row-major pass over the bitmap, returns false for a fully transparent bitmap.
+    bool findBounds(const cBitmap& input, uint32_t& left, uint32_t& top, uint32_t& right, uint32_t& bottom) const;
 
 protected:
+    const uint8_t m_alphaThreshold;
+
     cBitmap m_bitmap;
     sOffset m_offset;
 };
-
-class cTrimRigthBottom final : public cTrim
-{
-public:
-    cTrimRigthBottom(const sConfig& config);
-
-    virtual bool trim(const char* path, const cBitmap& input) override;
-
-private:
-    const sConfig& m_config;
-};
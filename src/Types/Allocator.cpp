@@ -0,0 +1,136 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "Allocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/mman.h>
+
+namespace
+{
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1u) & ~(alignment - 1u);
+    }
+
+} // namespace
+
+cAllocator& cAllocator::GetHeap()
+{
+    static cHeapAllocator Allocator;
+    return Allocator;
+}
+
+cAllocator& cAllocator::GetMmap()
+{
+    static cMmapAllocator Allocator;
+    return Allocator;
+}
+
+// ------------------------------------------------------------------------------
+
+void* cHeapAllocator::allocate(size_t size, size_t alignment)
+{
+    return ::aligned_alloc(alignment, AlignUp(std::max<size_t>(size, 1u), alignment));
+}
+
+void cHeapAllocator::free(void* ptr, size_t /*size*/)
+{
+    ::free(ptr);
+}
+
+// ------------------------------------------------------------------------------
+
+void* cMmapAllocator::allocate(size_t size, size_t /*alignment*/)
+{
+    // pages are always aligned enough
+    auto ptr = ::mmap(nullptr, std::max<size_t>(size, 1u), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+#if defined(MADV_HUGEPAGE)
+    (void)::madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
+    return ptr;
+}
+
+void cMmapAllocator::free(void* ptr, size_t size)
+{
+    ::munmap(ptr, std::max<size_t>(size, 1u));
+}
+
+// ------------------------------------------------------------------------------
+
+cArenaAllocator::cArenaAllocator(size_t blockSize)
+    : m_blockSize(blockSize)
+{
+}
+
+cArenaAllocator::~cArenaAllocator()
+{
+    for (auto& block : m_blocks)
+    {
+        ::free(block.data);
+    }
+}
+
+void* cArenaAllocator::allocate(size_t size, size_t alignment)
+{
+    if (m_blocks.empty() == false)
+    {
+        auto& block = m_blocks.back();
+        auto base = reinterpret_cast<uintptr_t>(block.data);
+        auto offset = AlignUp(base + m_used, alignment) - base;
+        if (offset + size <= block.size)
+        {
+            m_used = offset + size;
+            return static_cast<uint8_t*>(block.data) + offset;
+        }
+    }
+
+    const auto blockSize = AlignUp(std::max(m_blockSize, size + alignment), alignment);
+    auto data = ::aligned_alloc(alignment, blockSize);
+    if (data == nullptr)
+    {
+        return nullptr;
+    }
+
+    m_blocks.push_back({ data, blockSize });
+    m_used = size;
+
+    return data;
+}
+
+void cArenaAllocator::free(void* /*ptr*/, size_t /*size*/)
+{
+}
+
+void cArenaAllocator::reset()
+{
+    if (m_blocks.size() > 1)
+    {
+        auto largest = std::max_element(m_blocks.begin(), m_blocks.end(), [](const sBlock& a, const sBlock& b) {
+            return a.size < b.size;
+        });
+        std::swap(*largest, m_blocks.back());
+
+        for (size_t i = 0, size = m_blocks.size() - 1; i < size; i++)
+        {
+            ::free(m_blocks[i].data);
+        }
+        m_blocks.erase(m_blocks.begin(), m_blocks.end() - 1);
+    }
+
+    m_used = 0u;
+}
@@ -0,0 +1,70 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class cAllocator
+{
+public:
+    static cAllocator& GetHeap();
+    static cAllocator& GetMmap();
+
+public:
+    virtual ~cAllocator() = default;
+
+    // Returns nullptr if memory can't be allocated.
+    virtual void* allocate(size_t size, size_t alignment) = 0;
+    virtual void free(void* ptr, size_t size) = 0;
+};
+
+// Aligned blocks from the heap.
+class cHeapAllocator final : public cAllocator
+{
+public:
+    void* allocate(size_t size, size_t alignment) override;
+    void free(void* ptr, size_t size) override;
+};
+
+// Anonymous zero-filled pages, backed with huge pages where possible.
+class cMmapAllocator final : public cAllocator
+{
+public:
+    void* allocate(size_t size, size_t alignment) override;
+    void free(void* ptr, size_t size) override;
+};
+
+// Bump allocator, memory is released all at once by reset().
+class cArenaAllocator final : public cAllocator
+{
+public:
+    explicit cArenaAllocator(size_t blockSize);
+    ~cArenaAllocator();
+
+    cArenaAllocator(const cArenaAllocator&) = delete;
+    cArenaAllocator& operator=(const cArenaAllocator&) = delete;
+
+    void* allocate(size_t size, size_t alignment) override;
+    void free(void* ptr, size_t size) override;
+
+    // Keeps the largest block for the next allocations.
+    void reset();
+
+private:
+    struct sBlock
+    {
+        void* data;
+        size_t size;
+    };
+
+    const size_t m_blockSize;
+    std::vector<sBlock> m_blocks;
+    size_t m_used = 0u;
+};
@@ -7,6 +7,7 @@
 \**********************************************/
 
 #include "Bitmap.h"
+#include "Allocator.h"
 
 #include <algorithm>
 
@@ -17,42 +18,81 @@ cBitmap::~cBitmap()
 
 void cBitmap::clear()
 {
-    m_size = { 0u, 0u };
-
     if (m_manageData)
     {
         m_manageData = false;
-        delete[] m_data;
+        m_allocator->free(m_data, getDataSize());
+        m_allocator = nullptr;
     }
 
+    m_size = { 0u, 0u };
+    m_pitch = 0u;
+
     m_data = nullptr;
 }
 
-void cBitmap::createBitmap(const sSize& size)
+bool cBitmap::createBitmap(const sSize& size)
+{
+    return createBitmap(size, cAllocator::GetHeap());
+}
+
+bool cBitmap::createBitmap(const sSize& size, cAllocator& allocator)
 {
     clear();
 
+    const uint32_t rowPixels = RowAlignment / sizeof(Pixel);
+
     m_size = size;
+    m_pitch = (size.width + rowPixels - 1u) & ~(rowPixels - 1u);
 
     m_manageData = true;
-    m_data = new Pixel[size.width * size.height];
+    m_allocator = &allocator;
+    m_data = static_cast<Pixel*>(allocator.allocate(getDataSize(), RowAlignment));
+    if (m_data == nullptr)
+    {
+        m_manageData = false;
+        clear();
+        return false;
+    }
+
+    return true;
 }
 
 void cBitmap::setBitmap(const sSize& size, void* data)
+{
+    setBitmap(size, data, size.width);
+}
+
+void cBitmap::setBitmap(const sSize& size, void* data, uint32_t pitch)
 {
     clear();
 
     m_size = size;
+    m_pitch = pitch;
 
     m_data = static_cast<Pixel*>(data);
 }
 
+void cBitmap::setView(const cBitmap& other, const sOffset& offset, const sSize& size)
+{
+    auto data = const_cast<Pixel*>(other.getData()) + offset.y * other.m_pitch + offset.x;
+    setBitmap(size, data, other.m_pitch);
+}
+
 cBitmap& cBitmap::operator=(const cBitmap& other)
 {
     if (this != &other)
     {
         createBitmap(other.m_size);
-        std::copy(other.getData(), other.getData() + other.m_size.width * other.m_size.height, m_data);
+
+        auto src = other.getData();
+        auto dst = m_data;
+        for (uint32_t y = 0; y < m_size.height; y++)
+        {
+            std::copy(src, src + m_size.width, dst);
+            src += other.m_pitch;
+            dst += m_pitch;
+        }
     }
 
     return *this;
@@ -65,8 +105,10 @@ cBitmap& cBitmap::operator=(cBitmap&& other) noexcept
         clear();
 
         moveAndSet(m_size, other.m_size, {});
+        moveAndSet(m_pitch, other.m_pitch, 0u);
 
         moveAndSet(m_manageData, other.m_manageData, false);
+        moveAndSet(m_allocator, other.m_allocator, static_cast<cAllocator*>(nullptr));
         moveAndSet(m_data, other.m_data, static_cast<Pixel*>(nullptr));
     }
 
@@ -10,15 +10,31 @@
 
 #include "Types/Types.h"
 
+#include <cstddef>
+
+class cAllocator;
+
 class cBitmap final
 {
+public:
+    // Rows of created bitmaps are aligned to this size in bytes.
+    static const uint32_t RowAlignment = 64u;
+
 public:
     ~cBitmap();
 
     void clear();
 
-    void createBitmap(const sSize& size);
+    // Returns false and stays empty if memory can't be allocated.
+    bool createBitmap(const sSize& size);
+    bool createBitmap(const sSize& size, cAllocator& allocator);
+
+    // Doesn't take ownership, data must outlive the bitmap.
     void setBitmap(const sSize& size, void* data);
+    void setBitmap(const sSize& size, void* data, uint32_t pitch);
+
+    // Makes non-owning view of the region of other bitmap.
+    void setView(const cBitmap& other, const sOffset& offset, const sSize& size);
 
     cBitmap& operator=(const cBitmap& other);
     cBitmap& operator=(cBitmap&& other) noexcept;
@@ -35,9 +51,15 @@ public:
         return m_size;
     }
 
+    // distance between rows in pixels
     uint32_t getPitch() const
     {
-        return m_size.width;
+        return m_pitch;
+    }
+
+    size_t getDataSize() const
+    {
+        return size_t(m_pitch) * m_size.height * sizeof(Pixel);
     }
 
     struct Pixel
@@ -60,7 +82,9 @@ public:
 
 private:
     sSize m_size;
+    uint32_t m_pitch = 0u;
 
     bool m_manageData = false;
+    cAllocator* m_allocator = nullptr;
     Pixel* m_data = nullptr;
 };
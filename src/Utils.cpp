@@ -58,3 +58,34 @@ const char* isEnabled(bool enabled)
 {
     return enabled ? "enabled" : "disabled";
 }
+
+uint64_t getHash(const void* data, size_t size, uint64_t seed)
+{
+    const uint64_t Prime = 0x9e3779b97f4a7c15ull;
+
+    auto mix = [](uint64_t h) -> uint64_t {
+        h ^= h >> 32;
+        h *= 0xd6e8feb86659fd93ull;
+        h ^= h >> 32;
+        return h;
+    };
+
+    auto src = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed ^ (size * Prime);
+
+    for (; size >= 8; size -= 8, src += 8)
+    {
+        uint64_t word;
+        memcpy(&word, src, 8);
+        hash = mix((hash ^ word) * Prime);
+    }
+
+    if (size > 0)
+    {
+        uint64_t word = 0;
+        memcpy(&word, src, size);
+        hash = mix((hash ^ word) * Prime);
+    }
+
+    return mix(hash);
+}
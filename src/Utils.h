@@ -8,8 +8,10 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 uint64_t getCurrentTime();
 const char* formatNum(int num, char delimiter = '\'');
 const char* isEnabled(bool enabled);
+uint64_t getHash(const void* data, size_t size, uint64_t seed = 0u);
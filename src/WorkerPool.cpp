@@ -0,0 +1,65 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+uint32_t cWorkerPool::GetThreadsCount(uint32_t requested)
+{
+    if (requested == 0u)
+    {
+        requested = std::thread::hardware_concurrency();
+    }
+
+    return std::max(requested, 1u);
+}
+
+cWorkerPool::cWorkerPool(uint32_t threads)
+    : m_threads(GetThreadsCount(threads))
+{
+}
+
+void cWorkerPool::run(uint32_t count, const Job& job) const
+{
+    const auto threads = std::min(m_threads, count);
+    if (threads <= 1u)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            job(i, 0u);
+        }
+        return;
+    }
+
+    std::atomic<uint32_t> next(0u);
+    auto worker = [&next, &job, count](uint32_t workerIdx) {
+        for (uint32_t i = next++; i < count; i = next++)
+        {
+            job(i, workerIdx);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1u);
+    for (uint32_t w = 1; w < threads; w++)
+    {
+        pool.emplace_back(worker, w);
+    }
+
+    // calling thread works as worker 0
+    worker(0u);
+
+    for (auto& t : pool)
+    {
+        t.join();
+    }
+}
@@ -0,0 +1,35 @@
+/**********************************************\
+*
+*  Andrey A. Ugolnik
+*  http://www.ugolnik.info
+*  andrey@ugolnik.info
+*
+\**********************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+class cWorkerPool final
+{
+public:
+    static uint32_t GetThreadsCount(uint32_t requested);
+
+public:
+    explicit cWorkerPool(uint32_t threads);
+
+    uint32_t getThreadsCount() const
+    {
+        return m_threads;
+    }
+
+    using Job = std::function<void(uint32_t idx, uint32_t worker)>;
+
+    // Calls job for every index in [0, count). Indexes are handed out in
+    // ascending order, worker is in [0, getThreadsCount()) and is unique per thread.
+    void run(uint32_t count, const Job& job) const;
+
+private:
+    uint32_t m_threads;
+};
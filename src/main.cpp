@@ -8,12 +8,19 @@
 
 #include "Atlas/AtlasPacker.h"
 #include "Atlas/AtlasSize.h"
+#include "Atlas/Optimizer.h"
+#include "Atlas/Portfolio.h"
+#include "Atlas/SizeSearch.h"
 #include "Config.h"
 #include "Image.h"
 #include "ImageSaver.h"
+#include "PngWriter.h"
+#include "SpriteCache.h"
 #include "Trim.h"
+#include "Types/Allocator.h"
 #include "Types/Types.h"
 #include "Utils.h"
+#include "WorkerPool.h"
 
 #include <algorithm>
 #include <cstdlib>
@@ -21,6 +28,7 @@
 #include <dirent.h>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using ImagesList = std::vector<cImage*>;
@@ -37,6 +45,12 @@ void showHelp(const char* name, const sConfig& config);
 void printOversizeError(const sConfig& config, const sSize& atlasSize);
 void addPath(uint32_t trimCount, const std::string& path, bool recurse, FilesList& filesList);
 bool prepareSize(AtlasPacker* packer, const ImagesList& imagesList, const sSize& atlasSize);
+bool splitPages(const sConfig& config, const ImagesList& imagesList, std::vector<ImagesList>& pages);
+std::string getPageName(const char* name, uint32_t page);
+bool packPages(const sConfig& config, const cWorkerPool& workers, const std::vector<ImagesList>& pages,
+               const char* outputAtlasName, const char* outputResName, const char* outputStatsName,
+               const char* resPathPrefix);
+void removeIdentical(const cWorkerPool& workers, ImagesList& imagesList, ImagesList& aliasesList);
 
 int main(int argc, char* argv[])
 {
@@ -52,7 +66,10 @@ int main(int argc, char* argv[])
 
     const char* outputAtlasName = nullptr;
     const char* outputResName = nullptr;
+    const char* outputStatsName = nullptr;
     const char* resPathPrefix = nullptr;
+    const char* cacheDir = nullptr;
+    const char* portfolioSpec = nullptr;
     FilesList filesList;
 
     uint32_t trimCount = 0;
@@ -76,6 +93,13 @@ int main(int argc, char* argv[])
                 outputResName = argv[++i];
             }
         }
+        else if (::strcmp(arg, "-stats") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                outputStatsName = argv[++i];
+            }
+        }
         else if (::strcmp(arg, "-prefix") == 0)
         {
             if (i + 1 < argc)
@@ -83,6 +107,13 @@ int main(int argc, char* argv[])
                 resPathPrefix = argv[++i];
             }
         }
+        else if (::strcmp(arg, "-cache") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                cacheDir = argv[++i];
+            }
+        }
         else if (::strcmp(arg, "-b") == 0)
         {
             if (i + 1 < argc)
@@ -104,6 +135,20 @@ int main(int argc, char* argv[])
                 config.maxTextureSize = static_cast<uint32_t>(::atoi(argv[++i]));
             }
         }
+        else if (::strcmp(arg, "-j") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.threads = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
+        }
+        else if (::strcmp(arg, "-alpha") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.alphaThreshold = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
+        }
         else if (::strcmp(arg, "-tl") == 0)
         {
             if (i + 1 < argc)
@@ -123,9 +168,115 @@ int main(int argc, char* argv[])
         {
             config.alowDupes = true;
         }
+        else if (::strcmp(arg, "-rotate") == 0)
+        {
+            config.rotate = true;
+        }
+        else if (::strcmp(arg, "-dedup") == 0)
+        {
+            config.dedup = true;
+        }
         else if (::strcmp(arg, "-slow") == 0)
         {
-            config.slowMethod = true;
+            config.method = Method::Simple;
+        }
+        else if (::strcmp(arg, "-method") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                auto name = argv[++i];
+                if (AtlasPacker::ParseMethod(name, config.method) == false)
+                {
+                    ::printf("(WW) Unknown packing method '%s'.\n", name);
+                }
+            }
+        }
+        else if (::strcmp(arg, "-portfolio") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                portfolioSpec = argv[++i];
+            }
+        }
+        else if (::strcmp(arg, "-budget") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.timeBudget = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
+        }
+        else if (::strcmp(arg, "-optimize") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.optimizeTime = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
+        }
+        else if (::strcmp(arg, "-iterations") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.optimizeIterations = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
+        }
+        else if (::strcmp(arg, "-target") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.targetFill = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
+        }
+        else if (::strcmp(arg, "-seed") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.seed = ::strtoull(argv[++i], nullptr, 10);
+            }
+        }
+        else if (::strcmp(arg, "-heuristic") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                auto name = argv[++i];
+                if (AtlasPacker::ParseHeuristic(name, config.heuristic) == false)
+                {
+                    ::printf("(WW) Unknown heuristic '%s'.\n", name);
+                }
+            }
+        }
+        else if (::strcmp(arg, "-lazy") == 0)
+        {
+            config.lazyDecode = true;
+        }
+        else if (::strcmp(arg, "-speculative") == 0)
+        {
+            config.speculative = true;
+        }
+        else if (::strcmp(arg, "-multipage") == 0)
+        {
+            config.multipage = true;
+        }
+        else if (::strcmp(arg, "-plan") == 0)
+        {
+            config.plan = true;
+        }
+        else if (::strcmp(arg, "-png") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                auto name = argv[++i];
+                if (cPngWriter::ParsePreset(name, config.pngPreset) == false)
+                {
+                    ::printf("(WW) Unknown PNG preset '%s'.\n", name);
+                }
+            }
+        }
+        else if (::strcmp(arg, "-pngbudget") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.pngBudget = static_cast<uint32_t>(::atoi(argv[++i]));
+            }
         }
         else if (::strcmp(arg, "-dropext") == 0)
         {
@@ -135,6 +286,22 @@ int main(int argc, char* argv[])
         {
             config.overlay = true;
         }
+        else if (::strcmp(arg, "-overlaycolor") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                auto color = argv[++i];
+                color += color[0] == '#' ? 1 : 0;
+                config.overlayColor = static_cast<uint32_t>(::strtoul(color, nullptr, 16)) & 0xffffffu;
+            }
+        }
+        else if (::strcmp(arg, "-overlayalpha") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                config.overlayAlpha = std::min(static_cast<uint32_t>(::atoi(argv[++i])), 255u);
+            }
+        }
         else if (::strcmp(arg, "-nr") == 0)
         {
             recurse = false;
@@ -174,16 +341,72 @@ int main(int argc, char* argv[])
     ::printf("Border %u px.\n", config.border);
     ::printf("Padding %u px.\n", config.padding);
     ::printf("Overlay: %s.\n", isEnabled(config.overlay));
+    if (config.overlay)
+    {
+        ::printf("Overlay color %06X, alpha %u.\n", config.overlayColor, config.overlayAlpha);
+    }
     ::printf("Allow dupes: %s.\n", isEnabled(config.alowDupes));
+    ::printf("Pack identical sprites once: %s.\n", isEnabled(config.dedup));
     ::printf("Trim sprites: %s.\n", isEnabled(config.trim));
+    if (config.trim)
+    {
+        ::printf("Trim alpha threshold: %u.\n", config.alphaThreshold);
+    }
     ::printf("Power of Two: %s.\n", isEnabled(config.pot));
-    ::printf("Packing method: %s.\n", config.slowMethod ? "Slow" : "KD-Tree");
+    ::printf("Rotate sprites: %s.\n", isEnabled(config.rotate));
+    ::printf("Packing method: %s.\n", AtlasPacker::GetMethodName(config.method));
+    if (config.method == Method::MaxRects)
+    {
+        ::printf("MaxRects heuristic: %s.\n", AtlasPacker::GetHeuristicName(config.heuristic));
+    }
+
+    std::vector<cPortfolio::sEntry> portfolioEntries;
+    if (config.method == Method::Best)
+    {
+        if (portfolioSpec != nullptr)
+        {
+            cPortfolio::Parse(portfolioSpec, config, portfolioEntries);
+        }
+        if (portfolioEntries.empty())
+        {
+            cPortfolio::GetDefault(config, portfolioEntries);
+        }
+        ::printf("Portfolio: %u combinations, time budget %u ms.\n", (uint32_t)portfolioEntries.size(), config.timeBudget);
+    }
+    const bool isOptimize = config.optimizeTime != 0u || config.optimizeIterations != 0u;
+    ::printf("Optimizer: %s.\n", isEnabled(isOptimize));
+    if (isOptimize)
+    {
+        if (config.seed == 0u)
+        {
+            config.seed = getCurrentTime();
+        }
+        ::printf("Optimizer time %u ms, iterations %u, target fill %u%%, seed %llu.\n",
+                 config.optimizeTime,
+                 config.optimizeIterations,
+                 config.targetFill,
+                 static_cast<unsigned long long>(config.seed));
+    }
     ::printf("Drop extension: %s.\n", isEnabled(config.dropExt));
+    ::printf("Lazy decoding: %s.\n", isEnabled(config.lazyDecode));
     ::printf("Max atlas size %u px.\n", config.maxTextureSize);
+    ::printf("Multi-page output: %s.\n", isEnabled(config.multipage));
+    ::printf("Plan only: %s.\n", isEnabled(config.plan));
+    ::printf("PNG preset: %s.\n", cPngWriter::GetPresetName(config.pngPreset));
+    if (config.pngPreset == PngPreset::Max)
+    {
+        ::printf("PNG max preset budget %u ms.\n", config.pngBudget);
+    }
+    ::printf("Threads: %u.\n", cWorkerPool::GetThreadsCount(config.threads));
+    ::printf("Speculative packing: %s.\n", isEnabled(config.speculative));
     if (resPathPrefix != nullptr)
     {
         ::printf("Resource path prefix: %s.\n", resPathPrefix);
     }
+    if (cacheDir != nullptr)
+    {
+        ::printf("Sprite cache: %s.\n", cacheDir);
+    }
     ::printf("\n");
 
     const auto totalFiles = (uint32_t)filesList.size();
@@ -202,120 +425,280 @@ int main(int argc, char* argv[])
 
     // load images
     auto startTime = getCurrentTime();
-    std::unique_ptr<cTrim> trim(config.trim ? new cTrim() : nullptr);
-    ImagesList imagesList;
-    imagesList.reserve(filesList.size());
-
-    cAtlasSize sizeCalculator(config);
+    cWorkerPool workers(config.threads);
+    std::unique_ptr<cSpriteCache> cache(cacheDir != nullptr ? new cSpriteCache(cacheDir, config) : nullptr);
 
-    for (const auto& f : filesList)
+    // each worker owns its trimmer, results are collected per file to keep the order stable
+    std::vector<std::unique_ptr<cTrim>> trims(workers.getThreadsCount());
+    if (config.trim)
     {
+        for (auto& trim : trims)
+        {
+            trim.reset(new cTrim(config.alphaThreshold));
+        }
+    }
+
+    std::vector<std::unique_ptr<cImage>> loaded(filesList.size());
+    workers.run((uint32_t)filesList.size(), [&](uint32_t idx, uint32_t worker) {
+        const auto& f = filesList[idx];
         std::unique_ptr<cImage> image(new cImage());
-        if (image->load(f.path.c_str(), f.trimCount, trim.get()) == true)
+        auto trim = trims[worker].get();
+        auto isLoaded = config.lazyDecode
+            ? image->probe(f.path.c_str(), f.trimCount, trim, cache.get())
+            : image->load(f.path.c_str(), f.trimCount, trim, cache.get());
+        if (isLoaded)
         {
-            auto& bmp = image->getBitmap();
-            auto& size = bmp.getSize();
-            sizeCalculator.addRect(size);
+            loaded[idx] = std::move(image);
+        }
+    });
 
+    ImagesList imagesList;
+    imagesList.reserve(filesList.size());
+
+    for (size_t i = 0, size = filesList.size(); i < size; i++)
+    {
+        auto& image = loaded[i];
+        if (image != nullptr)
+        {
             imagesList.push_back(image.release());
         }
         else
         {
-            ::printf("(WW) Image '%s' not loaded.\n", f.path.c_str());
+            ::printf("(WW) Image '%s' not loaded.\n", filesList[i].path.c_str());
         }
     }
 
     auto ms = (getCurrentTime() - startTime) * 0.001f;
-    ::printf("Loaded %u (%u) images in %g ms.\n", (uint32_t)imagesList.size(), totalFiles, ms);
+    ::printf("%s %u (%u) images in %g ms.\n", config.lazyDecode ? "Probed" : "Loaded", (uint32_t)imagesList.size(), totalFiles, ms);
+
+    ImagesList aliasesList;
+    if (config.dedup)
+    {
+        startTime = getCurrentTime();
+        removeIdentical(workers, imagesList, aliasesList);
+
+        auto ms = (getCurrentTime() - startTime) * 0.001f;
+        ::printf("Found %u identical sprites in %g ms.\n", (uint32_t)aliasesList.size(), ms);
+    }
+
+    cAtlasSize sizeCalculator(config);
+    for (auto img : imagesList)
+    {
+        sizeCalculator.addRect(img->getSize());
+    }
 
     if (imagesList.size() > 0)
     {
-        auto packer = AtlasPacker::create(imagesList.size(), config);
+        // speculative mode packs a window of candidate sizes at once, one packer per candidate
+        const uint32_t window = config.speculative ? workers.getThreadsCount() : 1u;
+        std::vector<std::unique_ptr<AtlasPacker>> packers;
+        packers.push_back(AtlasPacker::create(imagesList.size(), config));
 
-        std::stable_sort(imagesList.begin(), imagesList.end(), [&packer](const cImage* a, const cImage* b) -> bool {
-            return packer->compare(a, b);
+        std::stable_sort(imagesList.begin(), imagesList.end(), [&packers](const cImage* a, const cImage* b) -> bool {
+            return packers[0]->compare(a, b);
         });
 
         auto atlasSize = sizeCalculator.calcSize();
-        if (sizeCalculator.isGood(atlasSize) == false)
+        if (sizeCalculator.isGood(atlasSize) == false && config.multipage == false)
         {
             printOversizeError(config, atlasSize);
             return -1;
         }
 
         ::printf("Packing:\n");
-        ::printf(" - trying %u x %u.\n", atlasSize.width, atlasSize.height);
         ::fflush(nullptr);
 
         startTime = getCurrentTime();
 
-        bool done = false;
-        do
+        // probes only lay rects out, pixels are touched once the size is found
+        cSizeSearch search(sizeCalculator, config.speculative);
+        std::vector<sSize> lastProbes;
+        auto probe = [&](const std::vector<sSize>& sizes, std::vector<char>& fits) {
+            for (const auto& size : sizes)
+            {
+                ::printf(" - trying %u x %u.\n", size.width, size.height);
+            }
+            ::fflush(nullptr);
+
+            while (packers.size() < sizes.size())
+            {
+                packers.push_back(AtlasPacker::create(imagesList.size(), config));
+            }
+
+            workers.run((uint32_t)sizes.size(), [&](uint32_t idx, uint32_t /*worker*/) {
+                fits[idx] = prepareSize(packers[idx].get(), imagesList, sizes[idx]);
+            });
+
+            lastProbes = sizes;
+        };
+
+        AtlasPacker* packer = nullptr;
+        cPortfolio portfolio(config, portfolioEntries);
+        if (config.method == Method::Best)
+        {
+            if (portfolio.run(workers, imagesList, config.timeBudget))
+            {
+                packer = portfolio.getPacker();
+                atlasSize = portfolio.getSize();
+
+                ::printf(" - best is %s.\n", cPortfolio::GetName(portfolio.getWinner()).c_str());
+            }
+        }
+        else if (search.find(probe, window, atlasSize))
         {
-            if (prepareSize(packer.get(), imagesList, atlasSize) == false)
+            // narrowing may end on a failed probe, repeat the layout for the found size
+            for (size_t i = 0; i < lastProbes.size(); i++)
             {
-                atlasSize = sizeCalculator.nextSize(atlasSize, 8u);
-                if (sizeCalculator.isGood(atlasSize) == false)
+                if (lastProbes[i].width == atlasSize.width && lastProbes[i].height == atlasSize.height)
                 {
-                    printOversizeError(config, atlasSize);
-                    return -1;
+                    packer = packers[i].get();
+                    break;
                 }
+            }
+            if (packer == nullptr)
+            {
+                packer = packers[0].get();
+                prepareSize(packer, imagesList, atlasSize);
+            }
+
+            ::printf(" - %u x %u found in %u probes (%u rounds), %u sizes skipped by bounds.\n",
+                     atlasSize.width,
+                     atlasSize.height,
+                     search.getProbesCount(),
+                     search.getRoundsCount(),
+                     search.getSkippedCount());
+        }
+
+        // optimizer outlives packer it hands over
+        std::unique_ptr<cOptimizer> optimizer;
+        if (packer != nullptr && isOptimize)
+        {
+            const auto& packerConfig = config.method == Method::Best
+                ? portfolio.getConfig()
+                : config;
+
+            ::printf("Optimizing:\n");
+            ::fflush(nullptr);
+
+            optimizer.reset(new cOptimizer(packerConfig, sizeCalculator, atlasSize));
+            if (optimizer->run(workers, imagesList, config.seed))
+            {
+                packer = optimizer->getPacker();
+                atlasSize = optimizer->getSize();
 
-                ::printf(" - trying %u x %u.\n", atlasSize.width, atlasSize.height);
-                ::fflush(nullptr);
+                ::printf(" - optimized to %u x %u, replay with -seed %llu -iterations %u -j 1.\n",
+                         atlasSize.width,
+                         atlasSize.height,
+                         static_cast<unsigned long long>(optimizer->getSeed()),
+                         optimizer->getIterations());
             }
             else
             {
-                packer->buildAtlas();
-                auto& atlas = packer->getBitmap();
+                ::printf(" - no smaller layout found.\n");
+            }
+        }
 
-                cImageSaver saver(atlas, outputAtlasName);
+        if (packer != nullptr)
+        {
+            const bool isBuilt = config.plan || packer->buildAtlas(atlasSize, workers);
+
+            // in plan mode saver only names the texture, atlas bitmap stays empty
+            cImageSaver saver(config, packer->getBitmap(), outputAtlasName);
 
-                // write texture
-                if (saver.save() == true)
+            // write texture
+            const bool isSaved = isBuilt && (config.plan || saver.save(workers));
+            if (isSaved)
+            {
+                outputAtlasName = saver.getAtlasName();
+
+                std::string atlasName = resPathPrefix != nullptr
+                    ? resPathPrefix
+                    : "";
+                atlasName += outputAtlasName;
+
+                const std::vector<AtlasPacker::sPage> pages{ { packer, atlasName, packer->getUsedSize(atlasSize) } };
+
+                // write resource file
+                if (outputResName != nullptr)
                 {
-                    outputAtlasName = saver.getAtlasName();
-
-                    // write resource file
-                    if (outputResName != nullptr)
-                    {
-                        std::string atlasName = resPathPrefix != nullptr
-                            ? resPathPrefix
-                            : "";
-                        atlasName += outputAtlasName;
-
-                        packer->generateResFile(outputResName, atlasName.c_str());
-                    }
-
-                    auto spritesArea = sizeCalculator.getArea();
-                    auto atlasArea = atlasSize.width * atlasSize.height;
-                    auto percent = static_cast<uint32_t>(100.0f * spritesArea / atlasArea);
-
-                    ::printf("Atlas '%s' (%u x %u, fill: %u%%) has been created",
-                             outputAtlasName,
-                             atlasSize.width,
-                             atlasSize.height,
-                             percent);
+                    AtlasPacker::GenerateResFile(outputResName, pages);
                 }
-                else
+                if (outputStatsName != nullptr)
                 {
-                    ::printf("Error writting atlas '%s' (%u x %u)", outputAtlasName,
-                             atlasSize.width,
-                             atlasSize.height);
+                    AtlasPacker::GenerateStatsFile(outputStatsName, pages);
                 }
 
-                auto ms = (getCurrentTime() - startTime) * 0.001f;
-                ::printf(" in %g ms.\n", ms);
-                ::fflush(nullptr);
+                auto spritesArea = sizeCalculator.getArea();
+                auto atlasArea = atlasSize.width * atlasSize.height;
+                auto percent = static_cast<uint32_t>(100.0f * spritesArea / atlasArea);
 
-                done = true;
+                ::printf("%s '%s' (%u x %u, fill: %u%%) has been created",
+                         config.plan ? "Plan of atlas" : "Atlas",
+                         outputAtlasName,
+                         atlasSize.width,
+                         atlasSize.height,
+                         percent);
             }
-        } while (done == false);
+            else
+            {
+                ::printf("Error writting atlas '%s' (%u x %u)", outputAtlasName,
+                         atlasSize.width,
+                         atlasSize.height);
+            }
+
+            auto ms = (getCurrentTime() - startTime) * 0.001f;
+            ::printf(" in %g ms.\n", ms);
+            if (isSaved && config.plan == false)
+            {
+                ::printf(" - texture %llu bytes, encoded at %.1f MB/s.\n",
+                         static_cast<unsigned long long>(saver.getFileSize()),
+                         saver.getSpeed());
+            }
+            ::fflush(nullptr);
+
+            if (isSaved == false)
+            {
+                return -1;
+            }
+        }
+        else if (config.multipage)
+        {
+            ::printf(" - sprites don't fit %u x %u, splitting into pages.\n", config.maxTextureSize, config.maxTextureSize);
+            ::fflush(nullptr);
+
+            std::vector<ImagesList> pages;
+            if (splitPages(config, imagesList, pages) == false)
+            {
+                printOversizeError(config, search.getOversize());
+                return -1;
+            }
+
+            const bool isSaved = packPages(config, workers, pages, outputAtlasName, outputResName, outputStatsName, resPathPrefix);
+
+            auto ms = (getCurrentTime() - startTime) * 0.001f;
+            if (isSaved == false)
+            {
+                ::printf("Error writting pages in %g ms.\n", ms);
+                return -1;
+            }
+
+            ::printf("Pages have been created in %g ms.\n", ms);
+            ::fflush(nullptr);
+        }
+        else
+        {
+            printOversizeError(config, search.getOversize());
+            return -1;
+        }
 
         for (auto img : imagesList)
         {
             delete img;
         }
+        for (auto img : aliasesList)
+        {
+            delete img;
+        }
     }
 
     return 0;
@@ -329,18 +712,41 @@ void showHelp(const char* name, const sConfig& config)
     ::printf("  INPUT_IMAGE        input image name or directory separated by space\n");
     ::printf("  -o ATLAS           output atlas name (default PNG)\n");
     ::printf("  -res DESC_TEXTURE  output atlas description as XML\n");
+    ::printf("  -stats FILE        write atlas sizes, sprites count and fill as JSON\n");
     ::printf("  -prefix STRING     add prefix to texture path\n");
+    ::printf("  -cache DIR         keep decoded sprites in DIR to speed up next runs\n");
     ::printf("  -pot               make power of two atlas (default %s)\n", isEnabled(config.pot));
     ::printf("  -nr                don't recurse in next directory\n");
+    ::printf("  -j count           number of worker threads, 0 - all cores (default %u)\n", config.threads);
+    ::printf("  -speculative       pack several sizes and aspect ratios at once, one per thread (default %s)\n", isEnabled(config.speculative));
     ::printf("  -tl count          trim left sprite's id by count (default 0)\n");
     ::printf("  -trim              trim sprites (default %s)\n", isEnabled(config.trim));
+    ::printf("  -alpha value       trim pixels with alpha not greater than value (default %u)\n", config.alphaThreshold);
     ::printf("  -overlay           overlay sprites (default %s)\n", isEnabled(config.overlay));
+    ::printf("  -overlaycolor hex  overlay color as RRGGBB (default %06X)\n", config.overlayColor);
+    ::printf("  -overlayalpha a    overlay opacity 0..255 (default %u)\n", config.overlayAlpha);
     ::printf("  -dupes             allow dupes (default %s)\n", isEnabled(config.alowDupes));
-    ::printf("  -slow              use slow method instead kd-tree (default %s)\n", isEnabled(config.slowMethod));
+    ::printf("  -dedup             pack identical sprites once (default %s)\n", isEnabled(config.dedup));
+    ::printf("  -method name       packing method: kdtree, slow, maxrects, skyline, best (default %s)\n", AtlasPacker::GetMethodName(config.method));
+    ::printf("  -heuristic name    maxrects heuristic: bssf, blsf, baf, cp (default %s)\n", AtlasPacker::GetHeuristicName(config.heuristic));
+    ::printf("  -portfolio list    combinations for best method, e.g. kdtree:area:rotate,maxrects:baf:height\n");
+    ::printf("                     sort keys: packer, area, maxside, height, width, perimeter\n");
+    ::printf("  -budget ms         time budget for best method (default %u ms)\n", config.timeBudget);
+    ::printf("  -optimize ms       search insertion orders and orientations for smaller atlas (default %u ms)\n", config.optimizeTime);
+    ::printf("  -iterations count  optimizer iterations per thread, 0 - until time is over (default %u)\n", config.optimizeIterations);
+    ::printf("  -target percent    stop optimizer at this atlas fill (default %u%%)\n", config.targetFill);
+    ::printf("  -seed value        optimizer random seed, 0 - from current time (default %llu)\n", static_cast<unsigned long long>(config.seed));
+    ::printf("  -rotate            allow turning sprites by 90 degrees clockwise (default %s)\n", isEnabled(config.rotate));
+    ::printf("  -slow              use slow method instead kd-tree, same as -method slow\n");
     ::printf("  -b size            add border around sprites (default %u px)\n", config.border);
     ::printf("  -p size            add padding between sprites (default %u px)\n", config.padding);
     ::printf("  -dropext           drop file extension from sprite id (default %s)\n", isEnabled(config.dropExt));
+    ::printf("  -lazy              read sprite sizes first, decode pixels while composing atlas (default %s)\n", isEnabled(config.lazyDecode));
     ::printf("  -max size          max atlas size (default %u px)\n", config.maxTextureSize);
+    ::printf("  -multipage         split sprites into ATLAS_0, ATLAS_1, ... if they don't fit max size (default %s)\n", isEnabled(config.multipage));
+    ::printf("  -plan              pack and write description only, atlas texture isn't composed (default %s)\n", isEnabled(config.plan));
+    ::printf("  -png preset        PNG compression: fast, default, max (default %s)\n", cPngWriter::GetPresetName(config.pngPreset));
+    ::printf("  -pngbudget ms      time budget of max preset, chunks left after it use default level (default %u ms)\n", config.pngBudget);
 }
 
 void printOversizeError(const sConfig& config, const sSize& atlasSize)
@@ -399,11 +805,334 @@ bool prepareSize(AtlasPacker* packer, const ImagesList& imagesList, const sSize&
     for (size_t i = 0, size = imagesList.size(); i < size; i++)
     {
         const auto& img = imagesList[i];
-        if (packer->add(img) == false)
+        if (packer->add(img, AtlasPacker::Turn::Any) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool splitPages(const sConfig& config, const ImagesList& imagesList, std::vector<ImagesList>& pages)
+{
+    const sSize maxSize{ config.maxTextureSize, config.maxTextureSize };
+    auto packer = AtlasPacker::create(imagesList.size(), config);
+
+    // first fit: sprites that don't go to the current page wait for the next one
+    ImagesList rest = imagesList;
+    while (rest.empty() == false)
+    {
+        ImagesList page;
+        ImagesList next;
+
+        packer->setSize(maxSize);
+        for (auto img : rest)
+        {
+            if (packer->add(img, AtlasPacker::Turn::Any))
+            {
+                page.push_back(img);
+            }
+            else
+            {
+                next.push_back(img);
+            }
+        }
+
+        // sprite is bigger than max size
+        if (page.empty())
         {
             return false;
         }
+
+        pages.push_back(std::move(page));
+        rest.swap(next);
+    }
+
+    if (pages.size() > 1)
+    {
+        // same pages count, but sprites area spread evenly, packing order is kept inside pages
+        const auto padding = config.padding * 2u;
+        std::vector<ImagesList> balanced(pages.size());
+        std::vector<uint64_t> areas(pages.size(), 0u);
+        for (auto img : imagesList)
+        {
+            auto it = std::min_element(areas.begin(), areas.end());
+            auto& size = img->getSize();
+            *it += uint64_t(size.width + padding) * (size.height + padding);
+            balanced[std::distance(areas.begin(), it)].push_back(img);
+        }
+
+        bool isFit = true;
+        for (const auto& page : balanced)
+        {
+            if (prepareSize(packer.get(), page, maxSize) == false)
+            {
+                isFit = false;
+                break;
+            }
+        }
+
+        if (isFit)
+        {
+            pages.swap(balanced);
+        }
+    }
+
+    return true;
+}
+
+std::string getPageName(const char* name, uint32_t page)
+{
+    std::string result = name;
+
+    auto point = result.find_last_of('.');
+    auto slash = result.find_last_of('/');
+    if (point == std::string::npos || (slash != std::string::npos && point < slash))
+    {
+        point = result.length();
+    }
+    result.insert(point, "_" + std::to_string(page));
+
+    return result;
+}
+
+bool packPages(const sConfig& config, const cWorkerPool& workers, const std::vector<ImagesList>& pages,
+               const char* outputAtlasName, const char* outputResName, const char* outputStatsName,
+               const char* resPathPrefix)
+{
+    struct sPageResult
+    {
+        std::unique_ptr<AtlasPacker> packer;
+        sSize size;
+        uint32_t spritesArea;
+        std::string atlasName;
+        bool isSaved;
+        uint64_t fileSize;
+        float speed; // MB/s
+    };
+
+    // pages are independent, each one is sized, composed and encoded by its own worker
+    const auto count = static_cast<uint32_t>(pages.size());
+    // threads left over from pages compose bands of each page
+    const cWorkerPool pageWorkers(std::max(1u, workers.getThreadsCount() / count));
+    std::vector<sPageResult> results(count);
+    workers.run(count, [&](uint32_t idx, uint32_t /*worker*/) {
+        const auto& page = pages[idx];
+        auto& result = results[idx];
+        result.packer = AtlasPacker::create(page.size(), config);
+        auto packer = result.packer.get();
+
+        cAtlasSize sizeCalculator(config);
+        for (auto img : page)
+        {
+            sizeCalculator.addRect(img->getSize());
+        }
+        result.spritesArea = sizeCalculator.getArea();
+
+        cSizeSearch search(sizeCalculator, false);
+        sSize lastProbe;
+        auto probe = [&](const std::vector<sSize>& sizes, std::vector<char>& fits) {
+            lastProbe = sizes[0];
+            fits[0] = prepareSize(packer, page, lastProbe);
+        };
+
+        auto& size = result.size;
+        if (search.find(probe, 1u, size) == false)
+        {
+            // page was filled at max size, so it fits there anyway
+            size = { config.maxTextureSize, config.maxTextureSize };
+            lastProbe = {};
+        }
+
+        if (lastProbe.width != size.width || lastProbe.height != size.height)
+        {
+            prepareSize(packer, page, size);
+        }
+
+        const bool isBuilt = config.plan || packer->buildAtlas(size, pageWorkers);
+
+        cImageSaver saver(config, packer->getBitmap(), getPageName(outputAtlasName, idx).c_str());
+        result.isSaved = isBuilt && (config.plan || saver.save(pageWorkers));
+        result.atlasName = saver.getAtlasName();
+        result.fileSize = saver.getFileSize();
+        result.speed = saver.getSpeed();
+    });
+
+    bool isSaved = true;
+    std::vector<AtlasPacker::sPage> resPages;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto& result = results[i];
+        const auto& size = result.size;
+        if (result.isSaved)
+        {
+            auto atlasArea = size.width * size.height;
+            auto percent = static_cast<uint32_t>(100.0f * result.spritesArea / atlasArea);
+
+            ::printf(" - atlas '%s' (%u x %u, fill: %u%%), %u sprites.\n",
+                     result.atlasName.c_str(),
+                     size.width,
+                     size.height,
+                     percent,
+                     result.packer->getRectsCount());
+            if (config.plan == false)
+            {
+                ::printf("   texture %llu bytes, encoded at %.1f MB/s.\n",
+                         static_cast<unsigned long long>(result.fileSize),
+                         result.speed);
+            }
+        }
+        else
+        {
+            ::printf("Error writting atlas '%s' (%u x %u).\n", result.atlasName.c_str(),
+                     size.width,
+                     size.height);
+            isSaved = false;
+        }
+
+        std::string atlasName = resPathPrefix != nullptr
+            ? resPathPrefix
+            : "";
+        atlasName += result.atlasName;
+        resPages.push_back({ result.packer.get(), atlasName, result.packer->getUsedSize(size) });
+    }
+
+    // description of partially written pages would refer to missing textures
+    if (isSaved == false)
+    {
+        if (outputResName != nullptr || outputStatsName != nullptr)
+        {
+            ::printf("(WW) Description isn't written, not all pages are saved.\n");
+        }
+        return false;
+    }
+
+    // write resource file
+    if (outputResName != nullptr)
+    {
+        AtlasPacker::GenerateResFile(outputResName, resPages);
+    }
+    if (outputStatsName != nullptr)
+    {
+        AtlasPacker::GenerateStatsFile(outputStatsName, resPages);
     }
 
     return true;
 }
+
+void removeIdentical(const cWorkerPool& workers, ImagesList& imagesList, ImagesList& aliasesList)
+{
+    const auto count = static_cast<uint32_t>(imagesList.size());
+    std::vector<uint8_t> isHashed(count);
+    workers.run(count, [&imagesList, &isHashed](uint32_t idx, uint32_t /*worker*/) {
+        isHashed[idx] = imagesList[idx]->updateHash() ? 1u : 0u;
+    });
+
+    // images with equal hash in list order, unreadable ones never become aliases
+    std::unordered_map<uint64_t, std::vector<uint32_t>> groups;
+    groups.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (isHashed[i] != 0u)
+        {
+            groups[imagesList[i]->getHash()].push_back(i);
+        }
+    }
+
+    std::vector<const std::vector<uint32_t>*> shared;
+    for (const auto& group : groups)
+    {
+        if (group.second.size() > 1u)
+        {
+            shared.push_back(&group.second);
+        }
+    }
+
+    // pixels of the first image of a group are decoded once, the rest of
+    // the group is compared with them in parallel
+    std::vector<cBitmap> firstPixels(shared.size());
+    workers.run((uint32_t)shared.size(), [&](uint32_t idx, uint32_t /*worker*/) {
+        const auto first = imagesList[shared[idx]->front()];
+        if (first->getBitmap().getData() == nullptr)
+        {
+            first->decode(firstPixels[idx], cAllocator::GetHeap());
+        }
+    });
+
+    struct sPair
+    {
+        uint32_t group;
+        uint32_t image;
+    };
+    std::vector<sPair> pairs;
+    for (uint32_t g = 0; g < shared.size(); g++)
+    {
+        for (size_t m = 1; m < shared[g]->size(); m++)
+        {
+            pairs.push_back({ g, (*shared[g])[m] });
+        }
+    }
+
+    std::vector<uint8_t> isSameAsFirst(count, 0u);
+    workers.run((uint32_t)pairs.size(), [&](uint32_t idx, uint32_t /*worker*/) {
+        const auto& pair = pairs[idx];
+        const auto first = imagesList[shared[pair.group]->front()];
+        const auto& pixels = first->getBitmap().getData() != nullptr
+            ? first->getBitmap()
+            : firstPixels[pair.group];
+        isSameAsFirst[pair.image] = imagesList[pair.image]->isSame(*first, pixels) ? 1u : 0u;
+    });
+    firstPixels.clear();
+
+    // first image with given pixels stays in list, others become its aliases,
+    // images differing from the first one of their group are hash collisions
+    std::unordered_map<uint64_t, ImagesList> unique;
+    unique.reserve(count);
+
+    ImagesList result;
+    result.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto img = imagesList[i];
+        if (isHashed[i] == 0u)
+        {
+            result.push_back(img);
+            continue;
+        }
+
+        const auto first = imagesList[groups[img->getHash()].front()];
+        auto& candidates = unique[img->getHash()];
+        auto it = candidates.end();
+        if (isSameAsFirst[i] != 0u)
+        {
+            it = std::find(candidates.begin(), candidates.end(), first);
+        }
+        else if (img != first)
+        {
+            it = std::find_if(candidates.begin(), candidates.end(), [img, first](const cImage* c) {
+                return c != first && c->isSame(*img);
+            });
+        }
+
+        if (it != candidates.end())
+        {
+            (*it)->addAlias(img);
+            aliasesList.push_back(img);
+        }
+        else
+        {
+            candidates.push_back(img);
+            result.push_back(img);
+        }
+    }
+
+    // pixels of aliases aren't needed anymore
+    for (auto img : aliasesList)
+    {
+        img->clear();
+    }
+
+    imagesList.swap(result);
+}